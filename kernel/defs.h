@@ -8,7 +8,10 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
 struct page;
+struct pagestat;
+struct pgcount;
 struct scfifo;
 
 // bio.c
@@ -35,10 +38,13 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
-int             kfileread(struct file*, uint64, int n);
-int             kfilewrite(struct file*, uint64, int n);
+int             filepread(struct file*, int, uint64, uint, int);
+int             filepwrite(struct file*, int, uint64, uint, int);
+int             filereadv(struct file*, uint64, int);
+int             filewritev(struct file*, uint64, int);
 // fs.c
 void            fsinit(int);
+void            dcunlink(struct inode*, char*);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
@@ -69,6 +75,7 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+void            kdup(void *);
 void            kinit(void);
 
 // log.c
@@ -76,6 +83,19 @@ void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            begin_opn(int);
+void            end_opn(int);
+int             log_maxop(void);
+
+// mmap.c
+uint64          mmap(uint64, int, int, struct file*, uint);
+int             munmap(uint64, uint64);
+int             vmafault(struct proc*, uint64, int);
+int             vmaevict(struct proc*, uint64, pte_t*);
+int             vmacopy(struct proc*, struct proc*);
+void            vmafree(struct proc*);
+int             vmaclash(struct proc*, uint64, uint64);
+uint64          vmaprivate(struct proc*);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -107,13 +127,17 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+void            kthread(char*, void (*)(void));
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeone(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 void            clearpages(struct proc*);
+extern struct pgcount pgtotal;
+int             pagestats(int, struct pagestat*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -123,11 +147,14 @@ void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             lockstatcopy(uint64, int);
 void            push_off(void);
 void            pop_off(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
+void            releasesleepnowake(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
@@ -153,11 +180,20 @@ void            syscall();
 struct inode*	create(char *path, short type, short major, short minor);
 int				isdirempty(struct inode *dp);
 
+// timer.c
+void            timerqinit(void);
+uint64          timer_now(void);
+void            timer_add(struct timer*, uint64);
+void            timer_cancel(struct timer*);
+int             timer_sleep(uint64);
+void            timer_slice(void);
+void            timer_idle(void);
+void            timer_sampling(uint64);
+int             timerintr(void);
+
 // trap.c
-extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
-extern struct spinlock tickslock;
 void            usertrapret(void);
 
 // uart.c
@@ -186,9 +222,52 @@ int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 void            allocate_page(pagetable_t, uint64 va);
+void            forget_page(struct proc*, uint64 va, int);
 int             page_fault(struct proc*, uint64 va);
+uint64          pagebudget(struct proc*);
+void            trackpages(struct proc*);
+int             setpglimit(struct proc*, int);
+
+// pgpolicy.c
+extern int      pgdefault;
+int             pgpolicy(struct proc*);
+void            pgsync(struct proc*);
+void            pginsert(struct proc*, struct page*);
+void            pgremove(struct proc*, struct page*);
+struct page*    pgvictim(struct proc*);
+void            pgpolicystat(struct proc*, struct pagestat*);
 void            update_counters(struct proc*);
-int             sh_or_init(struct proc*);
+int             setpgpolicy(struct proc*, int);
+int             setsyspolicy(int);
+
+// prof.c
+void            profinit(void);
+void            profintr(uint64, int);
+int             profctl(int);
+int             profread(uint64, int, uint64);
+
+// trace.c
+void            traceinit(void);
+void            trace(int, uint64, uint64);
+int             tracectl(int);
+int             traceread(uint64, int);
+
+// zswap.c
+void            zswapinit(void);
+int             zswap_store(char*);
+void            zswap_load(int, char*);
+void            zswap_dup(int);
+void            zswap_free(int);
+int             zswapctl(int);
+
+// laundry.c
+void            laundryinit(void);
+void            laundryd(void);
+void            laundry_add(struct proc*, int, char*);
+char*           laundry_rescue(struct proc*, struct page*);
+void            laundry_cancel(struct proc*, struct page*);
+void            laundry_drop(struct proc*);
+void            laundry_sync(struct proc*);
 
 // plic.c
 void            plicinit(void);
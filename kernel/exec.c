@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
@@ -48,10 +49,6 @@ exec(char *path, char **argv)
 
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
-  
-  #if SWAP_ALGO != NONE
-    clearpages(p);
-  #endif
 
   // Load program into memory.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
@@ -87,6 +84,11 @@ exec(char *path, char **argv)
   if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE, PTE_W)) == 0)
     goto bad;
   sz = sz1;
+  #if SWAP_ALGO != NONE
+    // a paged image must fit in memory and the swap file.
+    if(!p->pinexec && sz >= pagebudget(p))
+      goto bad;
+  #endif
   uvmclear(pagetable, sz-2*PGSIZE);
   sp = sz;
   stackbase = sp - PGSIZE;
@@ -115,9 +117,17 @@ exec(char *path, char **argv)
   // value, which goes in a0.
   p->trapframe->a1 = sp;
 
+  // mmap() regions belong to the old image, and their
+  // pages are tracked along with the rest of it.
+  vmafree(p);
+
   #if SWAP_ALGO != NONE
-    if (sh_or_init(p))
-      removeSwapFile(p);
+    acquiresleep(&p->pglock);
+    laundry_drop(p);
+    clearpages(p);
+    releasesleep(&p->pglock);
+    removeSwapFile(p);
+    p->pinned = p->pinexec;
   #endif
 
   // Save program name for debugging.
@@ -133,10 +143,18 @@ exec(char *path, char **argv)
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
 
+  proc_freepagetable(oldpagetable, oldsz);
   #if SWAP_ALGO != NONE
-    createSwapFile(p);
+    if (!p->pinned) {
+      createSwapFile(p);
+      trackpages(p);
+    }
   #endif
-  proc_freepagetable(oldpagetable, oldsz);
+  if(p->ioring){
+    // the ring was only mapped in the old image.
+    kfree((void*)p->ioring);
+    p->ioring = 0;
+  }
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
@@ -3,3 +3,11 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// mmap() protections and flags
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+
+#define MAP_SHARED    0x01
+#define MAP_PRIVATE   0x02
+#define MAP_ANONYMOUS 0x20
@@ -12,6 +12,7 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -101,6 +102,126 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// How many log blocks a write of n bytes to an inode may need:
+// the data blocks plus the i-node, up to 3 indirect blocks,
+// allocation blocks, and 2 blocks of slop for non-aligned writes.
+static int
+writeblocks(int n)
+{
+  int nblocks = ((n + BSIZE - 1) / BSIZE) * 2 + 1 + 3 + 2;
+
+  if(nblocks < MAXOPBLOCKS)
+    nblocks = MAXOPBLOCKS;
+  return nblocks;
+}
+
+// A copy to or from user memory under an inode lock or in a
+// log operation fails on a page that isn't in memory, since
+// walkaddr() doesn't fault pages in there (see faultin() in
+// vm.c). The read or write then goes again a page at a time
+// through a kernel page, copying to or from the user with no
+// file system locks held.
+
+// Read n bytes of ip at off into user memory at addr through
+// a kernel page. Returns the number of bytes read, or -1.
+static int
+readbounce(struct inode *ip, uint64 addr, uint off, int n)
+{
+  char *buf;
+  int tot, m, r;
+
+  if((buf = kalloc()) == 0)
+    return -1;
+  for(tot = 0; tot < n; tot += r){
+    m = n - tot < PGSIZE ? n - tot : PGSIZE;
+    ilock(ip);
+    r = readi(ip, 0, (uint64)buf, off + tot, m);
+    iunlock(ip);
+    if(r > 0 && copyout(myproc()->pagetable, addr + tot, buf, r) < 0)
+      r = -1;
+    if(r < 0){
+      tot = -1;
+      break;
+    }
+    if(r < m){
+      tot += r;
+      break;
+    }
+  }
+  kfree(buf);
+  return tot;
+}
+
+// Write n bytes at user address addr to the inode behind f,
+// starting at *off, through a kernel page, and advance *off
+// past what was written. Returns the number of bytes written.
+static int
+writebounce(struct file *f, uint64 addr, uint *off, int n)
+{
+  char *buf;
+  int tot, m, r, nblocks;
+
+  if((buf = kalloc()) == 0)
+    return 0;
+  for(tot = 0; tot < n; tot += r){
+    m = n - tot < PGSIZE ? n - tot : PGSIZE;
+    if(copyin(myproc()->pagetable, buf, addr + tot, m) < 0)
+      break;
+    nblocks = writeblocks(m);
+    begin_opn(nblocks);
+    ilock(f->ip);
+    if((r = writei(f->ip, 0, (uint64)buf, *off, m)) > 0)
+      *off += r;
+    iunlock(f->ip);
+    end_opn(nblocks);
+    if(r != m){
+      if(r > 0)
+        tot += r;
+      break;
+    }
+  }
+  kfree(buf);
+  return tot;
+}
+
+// Write n bytes at addr to the inode behind f, starting at *off,
+// and advance *off past what was written.
+// Large writes are split into as few log transactions as the log
+// allows, each reserving writeblocks() log blocks.
+// this really belongs lower down, since writei()
+// might be writing a device like the console.
+static int
+writeinode(struct file *f, int user_src, uint64 addr, uint *off, int n)
+{
+  int r = 0;
+  int max = ((log_maxop()-1-3-2) / 2) * BSIZE;
+  int i = 0;
+
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+    int nblocks = writeblocks(n1);
+
+    begin_opn(nblocks);
+    ilock(f->ip);
+    if ((r = writei(f->ip, user_src, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(f->ip);
+    end_opn(nblocks);
+
+    if(r != n1){
+      // error from writei, or a page of addr not in memory:
+      // write the rest through a kernel page.
+      if(user_src && r >= 0)
+        i += r + writebounce(f, addr + i + r, off, n - i - r);
+      break;
+    }
+    i += r;
+  }
+  return (i == n ? n : -1);
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -122,6 +243,8 @@ fileread(struct file *f, uint64 addr, int n)
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
+    if(r < 0 && (r = readbounce(f->ip, addr, f->off, n)) > 0)
+      f->off += r;
   } else {
     panic("fileread");
   }
@@ -134,7 +257,7 @@ fileread(struct file *f, uint64 addr, int n)
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
@@ -146,33 +269,7 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r != n1){
-        // error from writei
-        break;
-      }
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    ret = writeinode(f, 1, addr, &f->off, n);
   } else {
     panic("filewrite");
   }
@@ -180,81 +277,150 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
-// Read from file f.
-// addr is a kernel virtual address.
+// Read n bytes from file f at offset off, without using or
+// changing f->off. Only inodes have offsets.
+// addr is a user virtual address if user_dst, else kernel.
 int
-kfileread(struct file *f, uint64 addr, int n)
+filepread(struct file *f, int user_dst, uint64 addr, uint off, int n)
 {
-  int r = 0;
+  int r;
 
-  if(f->readable == 0)
+  if(f->readable == 0 || f->type != FD_INODE)
     return -1;
+  ilock(f->ip);
+  r = readi(f->ip, user_dst, addr, off, n);
+  iunlock(f->ip);
+  if(r < 0 && user_dst)
+    r = readbounce(f->ip, addr, off, n);
+  return r;
+}
 
-  if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+// Write n bytes to file f at offset off, without using or
+// changing f->off. Only inodes have offsets.
+// addr is a user virtual address if user_src, else kernel.
+int
+filepwrite(struct file *f, int user_src, uint64 addr, uint off, int n)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return writeinode(f, user_src, addr, &off, n);
+}
+
+// Copy in the user's array of cnt iovecs at addr.
+// Returns the total length, or -1.
+static int
+iovcopyin(struct iovec *iov, uint64 addr, int cnt)
+{
+  int i, total;
+
+  if(cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, addr, cnt*sizeof(iov[0])) < 0)
+    return -1;
+  total = 0;
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len < 0 || total + iov[i].iov_len < total)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
-  } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 0, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
-  } else {
-    panic("fileread");
+    total += iov[i].iov_len;
   }
-
-  return r;
+  return total;
 }
 
-// Write to file f.
-// addr is a kernel virtual address.
+// Read from file f into each of the cnt buffers described by
+// the user array of iovecs at addr, in turn. Stops early at a
+// short read, like read() does.
 int
-kfilewrite(struct file *f, uint64 addr, int n)
+filereadv(struct file *f, uint64 addr, int cnt)
 {
-  int r, ret = 0;
+  struct iovec iov[IOV_MAX];
+  int i, r, total;
 
-  if(f->writable == 0)
+  if(f->readable == 0 || iovcopyin(iov, addr, cnt) < 0)
     return -1;
 
-  if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
-      return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 0, addr + i, f->off, n1)) > 0)
-        f->off += r;
+  if(f->type != FD_INODE){
+    total = 0;
+    for(i = 0; i < cnt; i++){
+      if((r = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+        return total > 0 ? total : -1;
+      total += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    return total;
+  }
+
+  // lock the inode once, so that the buffers are filled from
+  // one consistent stretch of the file, unless one of them has
+  // to go through readbounce().
+  total = 0;
+  ilock(f->ip);
+  for(i = 0; i < cnt; i++){
+    r = readi(f->ip, 1, (uint64)iov[i].iov_base, f->off, iov[i].iov_len);
+    if(r < 0){
+      // a buffer not in memory: this one goes unlocked.
       iunlock(f->ip);
-      end_op();
+      r = readbounce(f->ip, (uint64)iov[i].iov_base, f->off, iov[i].iov_len);
+      ilock(f->ip);
+    }
+    if(r < 0){
+      if(total == 0)
+        total = -1;
+      break;
+    }
+    f->off += r;
+    total += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  iunlock(f->ip);
+  return total;
+}
 
-      if(r != n1){
-        // error from writei
-        break;
+// Write each of the cnt buffers described by the user array of
+// iovecs at addr to file f, in turn. If the whole write fits in
+// one log transaction it is done in one, so it is atomic with
+// respect to crashes; otherwise each buffer is written as by
+// write().
+int
+filewritev(struct file *f, uint64 addr, int cnt)
+{
+  struct iovec iov[IOV_MAX];
+  int i, r, n, total, nblocks;
+
+  if(f->writable == 0 || (n = iovcopyin(iov, addr, cnt)) < 0)
+    return -1;
+
+  total = 0;
+  i = 0;
+  if(f->type == FD_INODE && (nblocks = writeblocks(n)) <= log_maxop()){
+    begin_opn(nblocks);
+    ilock(f->ip);
+    for(; i < cnt; i++){
+      r = writei(f->ip, 1, (uint64)iov[i].iov_base, f->off, iov[i].iov_len);
+      if(r > 0){
+        f->off += r;
+        total += r;
       }
-      i += r;
+      if(r != iov[i].iov_len)
+        break;
     }
-    ret = (i == n ? n : -1);
-  } else {
-    panic("filewrite");
+    iunlock(f->ip);
+    end_opn(nblocks);
+    if(i == cnt)
+      return total;
+    // an error, or a buffer not in memory: the rest goes as
+    // by write(), which fails again if it was an error.
+    if(r < 0)
+      return -1;
+    iov[i].iov_base = (char*)iov[i].iov_base + r;
+    iov[i].iov_len -= r;
   }
 
-  return ret;
-}
\ No newline at end of file
+  for(; i < cnt; i++){
+    if((r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+      return -1;
+    total += r;
+  }
+  return total;
+}
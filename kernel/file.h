@@ -13,6 +13,16 @@ struct file {
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
 
+// A run of len file blocks, starting at file block lbn,
+// that are stored in consecutive disk blocks starting at addr.
+struct extent {
+  uint lbn;
+  uint addr;
+  uint len;
+};
+
+#define NEXTENT 4  // cached extents per in-memory inode
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
@@ -26,7 +36,11 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+
+  struct extent ext[NEXTENT]; // recently used block runs, not on disk
+  int extnext;                // next ext[] slot to replace
+  uint lastblk;               // last block allocated, goal for the next
 };
 
 // map major device number to device functions.
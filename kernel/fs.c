@@ -15,8 +15,8 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
-#include "proc.h"
 #include "sleeplock.h"
+#include "proc.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -26,6 +26,8 @@
 // only one device
 struct superblock sb; 
 
+static void bsuminit(void);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +46,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit();
 }
 
 // Zero a block.
@@ -59,27 +62,134 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// bsum summarizes the free-block bitmap in memory: the number
+// of free blocks described by each bitmap block, so that full
+// bitmap blocks can be skipped without reading them, and a
+// rotor where allocations without a goal resume searching.
+// A count is -1 until its bitmap block is first read. The
+// counts change only while the matching bitmap buf is locked.
+
+#define NBITMAP (FSSIZE/BPB + 1)
+
+struct {
+  struct spinlock lock;
+  int nfree[NBITMAP];
+  uint rotor;
+} bsum;
 
-// Allocate a zeroed disk block.
+static void
+bsuminit(void)
+{
+  int i;
+
+  if(sb.size > NBITMAP*BPB)
+    panic("bsuminit: file system too large");
+  initlock(&bsum.lock, "bsum");
+  for(i = 0; i < NBITMAP; i++)
+    bsum.nfree[i] = -1;
+  bsum.rotor = 0;
+}
+
+// Count the free blocks among the first n described by
+// bitmap block data.
+static int
+bcount(uchar *data, int n)
+{
+  uint *w = (uint*)data;
+  uint x;
+  int bi, k, nfree;
+
+  nfree = 0;
+  for(bi = 0; bi < n; bi += 32){
+    if((x = w[bi/32]) == 0xffffffff)
+      continue;
+    for(k = 0; k < 32 && bi + k < n; k++)
+      if((x & (1U << k)) == 0)
+        nfree++;
+  }
+  return nfree;
+}
+
+// Return the first free bit in [bi, end) of bitmap block
+// data, or -1, testing 32 bits at a time. Bit bi is bit
+// bi%8 of byte bi/8, which on little-endian RISC-V is bit
+// bi%32 of word bi/32.
+static int
+bfirstfree(uchar *data, int bi, int end)
+{
+  uint *w = (uint*)data;
+  uint x;
+  int k;
+
+  while(bi < end){
+    // Treat the bits of this word before bi as in use.
+    x = w[bi/32] | ((1U << (bi%32)) - 1);
+    if(x != 0xffffffff){
+      for(k = 0; x & (1U << k); k++)
+        ;
+      bi = (bi & ~31) + k;
+      return bi < end ? bi : -1;
+    }
+    bi = (bi & ~31) + 32;
+  }
+  return -1;
+}
+
+// Allocate a zeroed disk block, preferably goal or the
+// first free block after it, so that consecutive blocks
+// of a file end up next to each other on disk. With no
+// goal, continue from the last block allocated.
 // returns 0 if out of disk space.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal)
 {
-  int b, bi, m;
+  int b, bi, i, nb, end, n;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
+  if(goal == 0 || goal >= sb.size){
+    acquire(&bsum.lock);
+    goal = bsum.rotor;
+    release(&bsum.lock);
+    if(goal >= sb.size)
+      goal = 0;
+  }
+
+  // Visit every bitmap block once, starting with the one
+  // that holds goal, then wrap around to the bits of that
+  // first block that lie before goal.
+  nb = (sb.size + BPB - 1) / BPB;
+  for(i = 0; i <= nb; i++){
+    b = ((goal / BPB + i) % nb) * BPB;
+    bi = (i == 0) ? goal % BPB : 0;
+    end = (i == nb) ? goal % BPB : BPB;
+    if(b + end > sb.size)
+      end = sb.size - b;
+    if(bi >= end)
+      continue;
+
+    acquire(&bsum.lock);
+    n = bsum.nfree[b/BPB];
+    release(&bsum.lock);
+    if(n == 0)
+      continue;
+
     bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+    acquire(&bsum.lock);
+    if(bsum.nfree[b/BPB] < 0)
+      bsum.nfree[b/BPB] = bcount(bp->data, min(BPB, sb.size - b));
+    n = bsum.nfree[b/BPB];
+    release(&bsum.lock);
+    if(n > 0 && (bi = bfirstfree(bp->data, bi, end)) >= 0){
+      bp->data[bi/8] |= 1 << (bi % 8);  // Mark block in use.
+      log_write(bp);
+      acquire(&bsum.lock);
+      bsum.nfree[b/BPB]--;
+      bsum.rotor = b + bi + 1;
+      release(&bsum.lock);
+      brelse(bp);
+      bzero(dev, b + bi);
+      return b + bi;
     }
     brelse(bp);
   }
@@ -101,6 +211,10 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  acquire(&bsum.lock);
+  if(bsum.nfree[b/BPB] >= 0)
+    bsum.nfree[b/BPB]++;
+  release(&bsum.lock);
   brelse(bp);
 }
 
@@ -178,6 +292,8 @@ struct {
   struct inode inode[NINODE];
 } itable;
 
+static void dcinit(void);
+
 void
 iinit()
 {
@@ -187,9 +303,11 @@ iinit()
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
   }
+  dcinit();
 }
 
 static struct inode* iget(uint dev, uint inum);
+static void dcpurge(uint dev, uint dir);
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -299,6 +417,7 @@ ilock(struct inode *ip)
     panic("ilock");
 
   acquiresleep(&ip->lock);
+  myproc()->fsops++;
 
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
@@ -310,6 +429,9 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    memset(ip->ext, 0, sizeof(ip->ext));
+    ip->extnext = 0;
+    ip->lastblk = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -323,6 +445,7 @@ iunlock(struct inode *ip)
   if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
+  myproc()->fsops--;
   releasesleep(&ip->lock);
 }
 
@@ -347,6 +470,8 @@ iput(struct inode *ip)
 
     release(&itable.lock);
 
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -374,7 +499,86 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The next NDINDIRECT
+// blocks are listed in the indirect blocks that are in turn
+// listed in the double-indirect block ip->addrs[NDIRECT+1].
+//
+// Looking up a block past the direct ones costs one or two
+// extra bread()s, so each in-memory inode caches a few
+// extents (runs of file blocks that sit in consecutive disk
+// blocks). balloc() is asked for the block after the previous
+// one, so sequentially written files mostly form long runs.
+
+// Look up file block bn in ip's extent cache.
+// Returns 0 if bn isn't covered by a cached extent.
+static uint
+extlookup(struct inode *ip, uint bn)
+{
+  struct extent *e;
+
+  for(e = ip->ext; e < &ip->ext[NEXTENT]; e++){
+    if(e->len > 0 && bn >= e->lbn && bn < e->lbn + e->len)
+      return e->addr + (bn - e->lbn);
+  }
+  return 0;
+}
+
+// Remember that file block bn of ip is in disk block addr,
+// extending a cached extent if addr continues it.
+static void
+extadd(struct inode *ip, uint bn, uint addr)
+{
+  struct extent *e;
+
+  for(e = ip->ext; e < &ip->ext[NEXTENT]; e++){
+    if(e->len > 0 && bn == e->lbn + e->len && addr == e->addr + e->len){
+      e->len++;
+      return;
+    }
+  }
+  e = &ip->ext[ip->extnext];
+  ip->extnext = (ip->extnext + 1) % NEXTENT;
+  e->lbn = bn;
+  e->addr = addr;
+  e->len = 1;
+}
+
+// Allocate a block for ip near goal or, with no goal,
+// right after the last block allocated to ip.
+// returns 0 if out of disk space.
+static uint
+iballoc(struct inode *ip, uint goal)
+{
+  uint addr;
+
+  if(goal == 0 && ip->lastblk)
+    goal = ip->lastblk + 1;
+  if((addr = balloc(ip->dev, goal)) != 0)
+    ip->lastblk = addr;
+  return addr;
+}
+
+// Return entry idx of the indirect block at addr,
+// allocating a block near goal if the entry is empty.
+// returns 0 if out of disk space.
+static uint
+indirect(struct inode *ip, uint addr, uint idx, uint goal)
+{
+  uint *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[idx]) == 0){
+    addr = iballoc(ip, goal);
+    if(addr){
+      a[idx] = addr;
+      log_write(bp);
+    }
+  }
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -382,44 +586,91 @@ iunlockput(struct inode *ip)
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr, goal, n;
+
+  // Allocate right after the previous file block if we know
+  // where it is without reading an indirect block.
+  goal = 0;
+  if(bn > 0 && bn - 1 < NDIRECT)
+    goal = ip->addrs[bn - 1];
+  else if(bn > 0)
+    goal = extlookup(ip, bn - 1);
+  if(goal)
+    goal++;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
+      addr = iballoc(ip, goal);
       if(addr == 0)
         return 0;
       ip->addrs[bn] = addr;
     }
     return addr;
   }
-  bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
+  if((addr = extlookup(ip, bn)) != 0)
+    return addr;
+  n = bn - NDIRECT;
+
+  if(n < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
+      addr = iballoc(ip, goal);
       if(addr == 0)
         return 0;
       ip->addrs[NDIRECT] = addr;
+      if(goal)
+        goal = addr + 1;
     }
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
-      if(addr){
-        a[bn] = addr;
-        log_write(bp);
-      }
+    addr = indirect(ip, addr, n, goal);
+    if(addr)
+      extadd(ip, bn, addr);
+    return addr;
+  }
+  n -= NINDIRECT;
+
+  if(n < NDINDIRECT){
+    // Load double-indirect block, then the indirect
+    // block it points to, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0){
+      addr = iballoc(ip, goal);
+      if(addr == 0)
+        return 0;
+      ip->addrs[NDIRECT+1] = addr;
+      if(goal)
+        goal = addr + 1;
     }
-    brelse(bp);
+    if((addr = indirect(ip, addr, n / NINDIRECT, goal)) == 0)
+      return 0;
+    if(goal && goal == addr)
+      goal = addr + 1;
+    addr = indirect(ip, addr, n % NINDIRECT, goal);
+    if(addr)
+      extadd(ip, bn, addr);
     return addr;
   }
 
   panic("bmap: out of range");
 }
 
+// Free the indirect block at addr and the blocks it lists.
+static void
+freeindirect(uint dev, uint addr)
+{
+  int j;
+  struct buf *bp;
+  uint *a;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j])
+      bfree(dev, a[j]);
+  }
+  brelse(bp);
+  bfree(dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
@@ -437,17 +688,24 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    freeindirect(ip->dev, ip->addrs[NDIRECT]);
+    ip->addrs[NDIRECT] = 0;
+  }
+
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
     a = (uint*)bp->data;
     for(j = 0; j < NINDIRECT; j++){
       if(a[j])
-        bfree(ip->dev, a[j]);
+        freeindirect(ip->dev, a[j]);
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
   }
 
+  memset(ip->ext, 0, sizeof(ip->ext));
+  ip->lastblk = 0;
   ip->size = 0;
   iupdate(ip);
 }
@@ -546,6 +804,107 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory name cache.
+//
+// dcache remembers the results of recent dirlookup()s as
+// (dev, directory inum, name) -> (inum, offset of dirent), so
+// repeated lookups of the same path element skip the linear
+// scan of the directory. An entry with inum 0 records that the
+// name is absent. Entries for a directory are only created or
+// changed while that directory is locked, by dirlookup(),
+// dirlink() and dcunlink(), so they always agree with its
+// contents. The cache is direct-mapped: a new entry replaces
+// whatever was in its slot.
+
+struct dcentry {
+  uint dev;
+  uint dir;           // inum of the directory; 0 if slot unused
+  char name[DIRSIZ];
+  uint inum;          // 0 if name is not in dir
+  uint off;           // byte offset of the dirent in dir
+};
+
+struct {
+  struct spinlock lock;
+  struct dcentry entry[NDCACHE];
+} dcache;
+
+static void
+dcinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dcentry*
+dcslot(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.entry[h % NDCACHE];
+}
+
+// Look up name in directory dir. Returns 1 and sets
+// *inum (0 if name is known to be absent) and *off if
+// the cache knows the answer, 0 otherwise.
+static int
+dcget(uint dev, uint dir, char *name, uint *inum, uint *off)
+{
+  struct dcentry *e;
+  int hit;
+
+  acquire(&dcache.lock);
+  e = dcslot(dev, dir, name);
+  hit = e->dir == dir && e->dev == dev && namecmp(e->name, name) == 0;
+  if(hit){
+    *inum = e->inum;
+    *off = e->off;
+  }
+  release(&dcache.lock);
+  return hit;
+}
+
+static void
+dcput(uint dev, uint dir, char *name, uint inum, uint off)
+{
+  struct dcentry *e;
+
+  acquire(&dcache.lock);
+  e = dcslot(dev, dir, name);
+  e->dev = dev;
+  e->dir = dir;
+  strncpy(e->name, name, DIRSIZ);
+  e->inum = inum;
+  e->off = off;
+  release(&dcache.lock);
+}
+
+// Record that name has just been removed from directory dp.
+// Caller must hold dp->lock.
+void
+dcunlink(struct inode *dp, char *name)
+{
+  dcput(dp->dev, dp->inum, name, 0, 0);
+}
+
+// Forget every entry of directory dir, which is being freed
+// and whose inum may be reused.
+static void
+dcpurge(uint dev, uint dir)
+{
+  struct dcentry *e;
+
+  acquire(&dcache.lock);
+  for(e = dcache.entry; e < &dcache.entry[NDCACHE]; e++){
+    if(e->dev == dev && e->dir == dir)
+      e->dir = 0;
+  }
+  release(&dcache.lock);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
@@ -557,6 +916,14 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcget(dp->dev, dp->inum, name, &inum, &off)){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -567,10 +934,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcput(dp->dev, dp->inum, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
 
+  dcput(dp->dev, dp->inum, name, 0, 0);
   return 0;
 }
 
@@ -601,6 +970,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  dcput(dp->dev, dp->inum, name, inum, off);
 
   return 0;
 }
@@ -738,6 +1108,7 @@ removeSwapFile(struct proc* p)
     return -1;
   }
   fileclose(p->swapFile);
+  p->swapFile = 0;
   
   begin_op();
   if((dp = nameiparent(path, name)) == 0)
@@ -766,6 +1137,7 @@ removeSwapFile(struct proc* p)
   memset(&de, 0, sizeof(de));
   if(writei(dp,0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcunlink(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -819,15 +1191,12 @@ createSwapFile(struct proc* p)
 int
 writeToSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 {
-  p->swapFile->off = placeOnFile;
-  
-  return kfilewrite(p->swapFile, (uint64)buffer, size);
+  return filepwrite(p->swapFile, 0, (uint64)buffer, placeOnFile, size);
 }
 
 //return as sys_read (-1 when error)
 int
 readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 {
-  p->swapFile->off = placeOnFile;
-  return kfileread(p->swapFile, (uint64)buffer,  size);
+  return filepread(p->swapFile, 0, (uint64)buffer, placeOnFile, size);
 }
\ No newline at end of file
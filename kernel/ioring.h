@@ -0,0 +1,40 @@
+// A ring of I/O operations shared by a process and the kernel,
+// set up by ioring_setup() at address IORING. The process fills
+// sq[] and advances sqtail; ioring_enter() runs the queued
+// operations in order, advancing sqhead, and posts one entry in
+// cq[] per operation at cqtail. The process consumes completions
+// and advances cqhead. Indexes count up forever and are taken
+// modulo IORING_ENTRIES.
+
+#define IORING_OP_READ   1   // read(fd, addr, n)
+#define IORING_OP_WRITE  2   // write(fd, addr, n)
+#define IORING_OP_OPEN   3   // open(addr, n)
+#define IORING_OP_CLOSE  4   // close(fd)
+
+#define IORING_ENTRIES  64
+
+// submission queue entry
+struct io_sqe {
+  int op;        // IORING_OP_*
+  int fd;
+  uint64 addr;   // buffer, or path for open
+  int n;         // byte count, or mode for open
+  int pad;
+  uint64 data;   // returned in the completion, for the caller
+};
+
+// completion queue entry
+struct io_cqe {
+  uint64 data;   // from the submission
+  int res;       // what the system call would have returned
+  int pad;
+};
+
+struct ioring {
+  uint sqhead;
+  uint sqtail;
+  uint cqhead;
+  uint cqtail;
+  struct io_sqe sq[IORING_ENTRIES];
+  struct io_cqe cq[IORING_ENTRIES];
+};
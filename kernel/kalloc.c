@@ -8,6 +8,7 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "sleeplock.h"
 #include "proc.h"
 
 
@@ -20,9 +21,16 @@ struct run {
   struct run *next;
 };
 
+// index of the physical page at pa in kmem.ref[].
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 struct {
   struct spinlock lock;
   struct run *freelist;
+  // number of mappings of each allocated page. Pages of
+  // MAP_SHARED mappings are mapped by each process that
+  // inherited them, and are only freed by the last kfree().
+  uint ref[PA2REF(PHYSTOP)];
 } kmem;
 
 void
@@ -53,6 +61,15 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] > 1){
+    kmem.ref[PA2REF(pa)]--;
+    release(&kmem.lock);
+    return;
+  }
+  kmem.ref[PA2REF(pa)] = 0;
+  release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
@@ -74,13 +91,27 @@ kalloc(void)
    
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
-
+    kmem.ref[PA2REF(r)] = 1;
+  }
   release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
 
   return (void*)r;
-}
\ No newline at end of file
+}
+
+// Add a reference to the allocated page at pa, for
+// another mapping of it. Each reference is dropped
+// by a call to kfree().
+void
+kdup(void *pa)
+{
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] == 0)
+    panic("kdup");
+  kmem.ref[PA2REF(pa)]++;
+  release(&kmem.lock);
+}
@@ -0,0 +1,255 @@
+// Laundry: swap-out writeback in the background.
+//
+// swap_out() doesn't write an evicted page to the swap file
+// itself. It puts the page's frame on the laundry queue and
+// goes on, and the laundry writer, a kernel process, writes
+// the queued pages out in batches and frees their frames.
+// Each write is its own file system operation, so a batch
+// shares log commits (see log.c). A page faulted in again
+// before it is written is rescued: page_fault() takes its
+// frame back with no I/O at all.
+//
+// An entry is QUEUED until someone claims it to write it, and
+// then WRITING until the write is done; whoever writes it frees
+// the frame, unless the page was rescued meanwhile, and the
+// entry. The page's swap slot names its entry (struct
+// page.laundry, an index into laundry.ent plus one, so that 0
+// means none). A slot isn't given up while a write to it is in
+// flight: rescuing or forgetting a WRITING page waits for the
+// write. So there is at most one entry per slot, and writes
+// to a slot can't be reordered.
+//
+// When the queue is full, swap_out() writes a queued page
+// itself, so only then does an allocation wait for a write.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+
+#if SWAP_ALGO != NONE
+
+#define LAUNDRY_DELAY  (TICK_CYCLES / 10)  // how long a batch may gather
+
+enum lstate { LFREE, QUEUED, WRITING };
+
+struct lent {
+  enum lstate state;
+  struct proc *p;     // whose swap file
+  int slot;           // where in it
+  char *pa;           // the page's frame
+  int keep;           // rescued while WRITING: don't free pa
+};
+
+struct {
+  struct spinlock lock;
+  int nqueued;
+  struct lent ent[NLAUNDRY];
+} laundry;
+
+void
+laundryinit(void)
+{
+  initlock(&laundry.lock, "laundry");
+}
+
+// Waiting for the laundry's writes, or doing one, needs the
+// caller to be outside any file operation of its own: a write
+// needs log space, which the log can't free while an operation
+// is open, and an inode the caller holds locked may hold up the
+// other operations. faultin() in vm.c keeps page faults out of
+// file operations, so this only checks.
+static void
+nofsop(void)
+{
+  if(myproc()->fsops)
+    panic("laundry: in a file operation");
+}
+
+// Claim a QUEUED entry, of p if p isn't 0, to write it.
+// Caller must hold laundry.lock.
+static struct lent*
+claim(struct proc *p)
+{
+  struct lent *e;
+
+  for(e = laundry.ent; e < &laundry.ent[NLAUNDRY]; e++){
+    if(e->state == QUEUED && (p == 0 || e->p == p)){
+      e->state = WRITING;
+      laundry.nqueued--;
+      return e;
+    }
+  }
+  return 0;
+}
+
+// Write claimed entry e out, and free it.
+// Caller must hold laundry.lock, which is dropped meanwhile.
+static void
+clean(struct lent *e)
+{
+  nofsop();
+  release(&laundry.lock);
+  writeToSwapFile(e->p, e->pa, e->slot * PGSIZE, PGSIZE);
+  acquire(&laundry.lock);
+  if(!e->keep)
+    kfree(e->pa);
+  e->p->swapfile_pages[e->slot].laundry = 0;
+  e->state = LFREE;
+  e->p = 0;
+  e->keep = 0;
+  wakeup(&laundry);
+}
+
+// Queue frame pa, the page swapped out to slot of p's swap
+// file, to be written there. The frame is the laundry's now.
+void
+laundry_add(struct proc *p, int slot, char *pa)
+{
+  struct lent *e;
+
+  acquire(&laundry.lock);
+  for(;;){
+    for(e = laundry.ent; e < &laundry.ent[NLAUNDRY]; e++)
+      if(e->state == LFREE)
+        break;
+    if(e < &laundry.ent[NLAUNDRY])
+      break;
+    if((e = claim(0)) != 0){
+      clean(e);
+    } else {
+      nofsop();
+      sleep(&laundry, &laundry.lock);
+    }
+  }
+  e->state = QUEUED;
+  e->p = p;
+  e->slot = slot;
+  e->pa = pa;
+  p->swapfile_pages[slot].laundry = e - laundry.ent + 1;
+  laundry.nqueued++;
+  wakeup(&laundry.nqueued);
+  release(&laundry.lock);
+}
+
+// Take back the frame of page, one of p's swap slots, if it
+// hasn't been written out yet. Returns the frame, or 0 if the
+// page has to be read back in.
+char*
+laundry_rescue(struct proc *p, struct page *page)
+{
+  struct lent *e;
+  char *pa;
+
+  acquire(&laundry.lock);
+  if(page->laundry == 0){
+    release(&laundry.lock);
+    return 0;
+  }
+  e = &laundry.ent[page->laundry - 1];
+  pa = e->pa;
+  if(e->state == QUEUED){
+    e->state = LFREE;
+    e->p = 0;
+    laundry.nqueued--;
+    page->laundry = 0;
+    wakeup(&laundry);
+  } else {
+    e->keep = 1;
+    nofsop();
+    while(page->laundry)
+      sleep(&laundry, &laundry.lock);
+  }
+  release(&laundry.lock);
+  return pa;
+}
+
+// page, one of p's swap slots, no longer holds a page: drop
+// its frame if it hasn't been written yet, or else wait for
+// the write, which frees it.
+void
+laundry_cancel(struct proc *p, struct page *page)
+{
+  struct lent *e;
+
+  acquire(&laundry.lock);
+  if(page->laundry){
+    e = &laundry.ent[page->laundry - 1];
+    if(e->state == QUEUED){
+      kfree(e->pa);
+      e->state = LFREE;
+      e->p = 0;
+      laundry.nqueued--;
+      page->laundry = 0;
+      wakeup(&laundry);
+    }
+    if(page->laundry)
+      nofsop();
+    while(page->laundry)
+      sleep(&laundry, &laundry.lock);
+  }
+  release(&laundry.lock);
+}
+
+// p is done with its swap file: cancel all of its pages.
+void
+laundry_drop(struct proc *p)
+{
+  for(int i = 0; i < MAX_PAGED_PAGES; i++)
+    laundry_cancel(p, &p->swapfile_pages[i]);
+}
+
+// Write all of p's queued pages out now, so that its swap
+// file holds all of its swapped-out pages.
+void
+laundry_sync(struct proc *p)
+{
+  struct lent *e;
+
+  acquire(&laundry.lock);
+  for(;;){
+    if((e = claim(p)) != 0){
+      clean(e);
+      continue;
+    }
+    for(e = laundry.ent; e < &laundry.ent[NLAUNDRY]; e++)
+      if(e->p == p)
+        break;
+    if(e == &laundry.ent[NLAUNDRY])
+      break;
+    nofsop();
+    sleep(&laundry, &laundry.lock);
+  }
+  release(&laundry.lock);
+}
+
+// The laundry writer. Waits for pages to be queued, and a
+// little longer for more to join them unless the queue is
+// filling, then writes out all there are.
+void
+laundryd(void)
+{
+  struct lent *e;
+
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+
+  acquire(&laundry.lock);
+  for(;;){
+    while(laundry.nqueued == 0)
+      sleep(&laundry.nqueued, &laundry.lock);
+    if(laundry.nqueued < NLAUNDRY / 2){
+      release(&laundry.lock);
+      timer_sleep(timer_now() + LAUNDRY_DELAY);
+      acquire(&laundry.lock);
+    }
+    while((e = claim(0)) != 0)
+      clean(e);
+  }
+}
+
+#endif
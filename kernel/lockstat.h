@@ -0,0 +1,8 @@
+// Contention statistics for all spinlocks with the same name,
+// as returned by the lockstat() system call.
+struct lockstat {
+  char name[16];      // lock name, truncated
+  uint64 nacquire;    // acquire() calls
+  uint64 ncontend;    // acquire() calls that had to wait
+  uint64 spincycles;  // cycles spent waiting
+};
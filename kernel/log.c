@@ -4,8 +4,10 @@
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "proc.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -21,6 +23,14 @@
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
 //
+// begin_op() reserves MAXOPBLOCKS blocks of log space.
+// A system call that knows it will write more (e.g. a large
+// write()) can reserve n blocks with begin_opn(n), up to
+// log_maxop(), and must finish with end_opn(n).
+//
+// The number of log blocks comes from the super block, so
+// mkfs decides how big transactions can get; LOGSIZE only
+// bounds how many block numbers fit in the header block.
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
@@ -42,6 +52,7 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks reserved by outstanding sys calls.
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
@@ -60,6 +71,10 @@ initlog(int dev, struct superblock *sb)
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  if(log.size - 1 > LOGSIZE)
+    log.size = LOGSIZE + 1;  // header can't name more blocks than this
+  if(log.size - 1 < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
   recover_from_log();
 }
@@ -122,34 +137,58 @@ recover_from_log(void)
   write_head(); // clear the log
 }
 
-// called at the start of each FS system call.
+// Largest number of blocks a single FS system call may reserve.
+// Half the log, so that a big writer still leaves room for others.
+int
+log_maxop(void)
+{
+  int n = (log.size - 1) / 2;
+  if(n < MAXOPBLOCKS)
+    n = MAXOPBLOCKS;
+  return n;
+}
+
+// called at the start of an FS system call that may
+// write up to n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  int waits = 0;
+
+  if(n > log_maxop())
+    panic("begin_opn: too many blocks");
+
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+      waits++;
+    } else if(log.lh.n + log.reserved + n > log.size - 1){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
+      waits++;
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->fsops++;
+      trace(TR_BEGINOP, log.outstanding, waits);
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
+// called at the end of an FS system call started with begin_opn(n).
 // commits if this was the last outstanding operation.
 void
-end_op(void)
+end_opn(int n)
 {
   int do_commit = 0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= n;
+  myproc()->fsops--;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
@@ -157,7 +196,7 @@ end_op(void)
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
+    // and decrementing log.reserved has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
@@ -174,6 +213,20 @@ end_op(void)
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call.
+void
+end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
 // Copy modified blocks from cache to log.
 static void
 write_log(void)
@@ -194,11 +247,13 @@ static void
 commit()
 {
   if (log.lh.n > 0) {
+    trace(TR_COMMIT, log.lh.n, 0);
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
     install_trans(0); // Now install writes to home locations
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
+    trace(TR_COMMITDONE, 0, 0);
   }
 }
 
@@ -27,8 +27,17 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    traceinit();     // kernel event trace
+    profinit();      // sampling profiler
+#if SWAP_ALGO != NONE
+    zswapinit();     // compressed swap pool
+    laundryinit();   // swap-out writeback queue
+#endif
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
+#if SWAP_ALGO != NONE
+    kthread("laundryd", laundryd); // swap-out writer
+#endif
     __sync_synchronize();
     started = 1;
   } else {
@@ -29,6 +29,9 @@
 #define CLINT 0x2000000L
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define MTIME_HZ 10000000L           // mtime cycles per second in qemu.
+#define NS_PER_CYCLE (1000000000L / MTIME_HZ)
+#define TICK_CYCLES 1000000          // one tick, the time slice; 1/10th second.
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -62,6 +65,12 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   mmap() regions, placed downwards from MMAPTOP
+//   IORING (p->ioring, if the process has set it up)
+//   USYSCALL (p->usyscall, read-only, used by usys.S)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define USYSCALL (TRAPFRAME - PGSIZE)
+#define IORING (USYSCALL - PGSIZE)
+#define MMAPTOP IORING
@@ -0,0 +1,423 @@
+//
+// Memory-mapped regions: mmap() and munmap().
+//
+// Each process has up to NVMA regions, recorded in p->vma[],
+// placed downwards from MMAPTOP. Pages of a region are only
+// allocated when first touched, by vmafault(): zero-filled for
+// anonymous regions, or read from the inode for file regions.
+// The exception is MAP_SHARED|MAP_ANONYMOUS, whose pages are
+// allocated by mmap() itself, so that fork() hands the child
+// the same physical pages (see kdup() in kalloc.c).
+//
+// When paging is on, faulted-in pages are tracked like any
+// other page, and the page-replacement policy may pick them.
+// vmaevict() writes dirty MAP_SHARED file pages back to the
+// file and simply drops clean file pages, which vmafault()
+// can read again later; everything else goes to the swap file.
+// Shared anonymous pages have no single owner whose swap file
+// could hold them, so they are never tracked or evicted.
+//
+// There is no page cache: processes that map the same file
+// only see each other's writes once they reach the file,
+// at eviction, munmap() or exit().
+//
+// System calls that copy to or from a region fault its pages
+// in through walkaddr(), except where the copy is done under a
+// spinlock, as pipes and the console do: there an untouched
+// page fails the copy. File reads and writes copy under the
+// inode lock, where walkaddr() won't fault, so they go again
+// through a kernel page (see readbounce() in file.c).
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+
+// Return the region of p that contains va, or 0.
+static struct vma*
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// Does any region of p overlap [lo, hi)?
+int
+vmaclash(struct proc *p, uint64 lo, uint64 hi)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && lo < v->addr + v->len && v->addr < hi)
+      return 1;
+  return 0;
+}
+
+#if SWAP_ALGO != NONE
+// Are v's pages tracked by the page-replacement policy?
+static int
+vmatracked(struct proc *p, struct vma *v)
+{
+  if(v->f == 0 && (v->flags & MAP_SHARED))
+    return 0;
+  return !p->pinned;
+}
+#endif
+
+// Bytes of p's regions that may need swap file slots:
+// everything except MAP_SHARED regions.
+uint64
+vmaprivate(struct proc *p)
+{
+  struct vma *v;
+  uint64 n;
+
+  n = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && (v->flags & MAP_PRIVATE))
+      n += v->len;
+  return n;
+}
+
+// Write the page at pa, mapped at va in file region v,
+// back to the file. Does not extend the file.
+static void
+vmawrite(struct vma *v, uint64 va, uint64 pa)
+{
+  uint off, size;
+  int n;
+
+  off = v->off + (va - v->addr);
+  ilock(v->f->ip);
+  size = v->f->ip->size;
+  iunlock(v->f->ip);
+  if(off >= size)
+    return;
+  n = size - off < PGSIZE ? size - off : PGSIZE;
+  filepwrite(v->f, 0, pa, off, n);
+}
+
+// Remove the mappings of [addr, addr+len) in region v of p,
+// writing dirty pages of MAP_SHARED files back first.
+static void
+vmaunmap(struct proc *p, struct vma *v, uint64 addr, uint64 len)
+{
+  uint64 a, pa;
+  pte_t *pte;
+
+  for(a = addr; a < addr + len; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & (PTE_V | PTE_PG)) == 0)
+      continue;
+    if(*pte & PTE_V){
+      pa = PTE2PA(*pte);
+      if(v->f && (v->flags & MAP_SHARED) && (*pte & PTE_D))
+        vmawrite(v, a, pa);
+      kfree((void*)pa);
+    }
+#if SWAP_ALGO != NONE
+    if(vmatracked(p, v) && (*pte & PTE_FILL) == 0){
+      acquiresleep(&p->pglock);
+      forget_page(p, a, (*pte & PTE_V) != 0);
+      releasesleep(&p->pglock);
+    }
+#endif
+    *pte = 0;
+  }
+}
+
+// Map len bytes of f starting at off, or anonymous memory if
+// f is 0, into the current process.
+// Returns the address of the mapping, or -1.
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v, *fv;
+  uint64 a;
+  char *mem;
+
+  len = PGROUNDUP(len);
+  if(len == 0 || len >= MMAPTOP || off % PGSIZE)
+    return -1;
+  if((prot & PROT_READ) == 0 || (prot & ~(PROT_READ|PROT_WRITE)))
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(f){
+    if(f->type != FD_INODE || f->readable == 0)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && f->writable == 0)
+      return -1;
+  }
+#if SWAP_ALGO != NONE
+  // private pages may all end up in the swap file, next to the heap.
+  if(!p->pinned && (flags & MAP_PRIVATE) &&
+     PGROUNDUP(p->sz) + vmaprivate(p) + len > pagebudget(p))
+    return -1;
+#endif
+
+  fv = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len == 0){
+      fv = v;
+      break;
+    }
+  if(fv == 0)
+    return -1;
+
+  // take the highest gap that fits, below MMAPTOP and above the heap.
+  a = MMAPTOP - len;
+again:
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->len && a < v->addr + v->len && v->addr < a + len){
+      if(v->addr < len)
+        return -1;
+      a = v->addr - len;
+      goto again;
+    }
+  }
+  if(a < PGROUNDUP(p->sz))
+    return -1;
+
+  v = fv;
+  v->addr = a;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = f ? filedup(f) : 0;
+  v->off = off;
+
+  if(f == 0 && (flags & MAP_SHARED)){
+    for(; a < v->addr + len; a += PGSIZE){
+      if((mem = kalloc()) == 0)
+        goto bad;
+      memset(mem, 0, PGSIZE);
+      if(mappages(p->pagetable, a, PGSIZE, (uint64)mem, PTE_U|PTE_R|PTE_W) != 0){
+        kfree(mem);
+        goto bad;
+      }
+    }
+  }
+  return v->addr;
+
+bad:
+  vmaunmap(p, v, v->addr, a - v->addr);
+  v->len = 0;
+  return -1;
+}
+
+// Unmap [addr, addr+len) of the current process, which must
+// lie within a single region. The region may shrink, or be
+// split in two.
+// Returns 0 on success, -1 on failure.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv;
+  uint64 end;
+
+  len = PGROUNDUP(len);
+  if(addr % PGSIZE || len == 0 || (v = vmalookup(p, addr)) == 0)
+    return -1;
+  end = v->addr + v->len;
+  if(addr + len < addr || addr + len > end)
+    return -1;
+
+  if(addr > v->addr && addr + len < end){
+    // a hole in the middle leaves two regions.
+    for(nv = p->vma; nv < &p->vma[NVMA]; nv++)
+      if(nv->len == 0)
+        break;
+    if(nv == &p->vma[NVMA])
+      return -1;
+    *nv = *v;
+    nv->addr = addr + len;
+    nv->len = end - nv->addr;
+    nv->off = v->off + (nv->addr - v->addr);
+    if(nv->f)
+      filedup(nv->f);
+  }
+
+  vmaunmap(p, v, addr, len);
+  if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+    v->len -= len;
+  } else {
+    v->len = addr - v->addr;
+  }
+  if(v->len == 0 && v->f){
+    fileclose(v->f);
+    v->f = 0;
+  }
+  return 0;
+}
+
+// Handle a page fault at va by the current process p, if va
+// is in one of its regions and not yet mapped.
+// Returns 0 if the page is now mapped, -1 if the fault
+// is not one for vmafault().
+int
+vmafault(struct proc *p, uint64 va, int write)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+  int perm;
+
+  if((v = vmalookup(p, va)) == 0)
+    return -1;
+  if(write && (v->prot & PROT_WRITE) == 0)
+    return -1;
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & (PTE_V | PTE_PG)))
+    return -1;
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(v->f){
+    ilock(v->f->ip);
+    if(readi(v->f->ip, 0, (uint64)mem, v->off + (va - v->addr), PGSIZE) < 0){
+      iunlock(v->f->ip);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(v->f->ip);
+  }
+
+  perm = PTE_U | PTE_R;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+#if SWAP_ALGO != NONE
+  if(vmatracked(p, v)){
+    acquiresleep(&p->pglock);
+    allocate_page(p->pagetable, va);
+    releasesleep(&p->pglock);
+  }
+#endif
+  return 0;
+}
+
+// The page-replacement policy chose page va of p, whose
+// PTE is pte, for eviction. If va belongs to a file region,
+// write the page back if it is a dirty MAP_SHARED page, and
+// unmap it, so that vmafault() reads it again when needed.
+// Returns 1 if done, 0 if the page should go to the swap file.
+int
+vmaevict(struct proc *p, uint64 va, pte_t *pte)
+{
+  struct vma *v;
+
+  if((v = vmalookup(p, va)) == 0 || v->f == 0)
+    return 0;
+  if(*pte & PTE_D){
+    if(v->flags & MAP_PRIVATE)
+      return 0;
+    vmawrite(v, va, PTE2PA(*pte));
+  }
+  *pte = 0;
+  return 1;
+}
+
+// Give child np a copy of p's regions, as fork() does.
+// MAP_SHARED pages are shared with the child, others copied.
+// Returns 0 on success, -1 on failure.
+int
+vmacopy(struct proc *p, struct proc *np)
+{
+  struct vma *v, *nv;
+  pte_t *pte, *npte;
+  uint64 a, pa;
+  char *mem;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    if(v->len == 0)
+      continue;
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & (PTE_V | PTE_PG)) == 0)
+        continue;
+      if((*pte & PTE_V) == 0){
+        // in the swap file, which fork() copies, or
+        // a PTE_FILL page, all in the PTE.
+        if((npte = walk(np->pagetable, a, 1)) == 0)
+          goto bad;
+        *npte = *pte;
+        continue;
+      }
+      pa = PTE2PA(*pte);
+      if(v->flags & MAP_SHARED){
+        kdup((void*)pa);
+        mem = (char*)pa;
+      } else {
+        if((mem = kalloc()) == 0)
+          goto bad;
+        memmove(mem, (char*)pa, PGSIZE);
+      }
+      if(mappages(np->pagetable, a, PGSIZE, (uint64)mem, PTE_FLAGS(*pte)) != 0){
+        kfree(mem);
+        goto bad;
+      }
+    }
+    nv = &np->vma[i];
+    *nv = *v;
+    if(nv->f)
+      filedup(nv->f);
+  }
+  return 0;
+
+bad:
+  // np's pages are not tracked yet, so just drop them,
+  // including those of the region being copied.
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    for(a = v->addr; v->len && a < v->addr + v->len; a += PGSIZE){
+      if((npte = walk(np->pagetable, a, 0)) == 0)
+        continue;
+      if(*npte & PTE_V)
+        kfree((void*)PTE2PA(*npte));
+      *npte = 0;
+    }
+    nv = &np->vma[i];
+    if(nv->len && nv->f)
+      fileclose(nv->f);
+    nv->len = 0;
+  }
+  return -1;
+}
+
+// Unmap all of p's regions, as exit() and exec() do.
+void
+vmafree(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    vmaunmap(p, v, v->addr, v->len);
+    if(v->f)
+      fileclose(v->f);
+    v->f = 0;
+    v->len = 0;
+  }
+}
@@ -0,0 +1,45 @@
+// Paging statistics for one process, or totals for the whole
+// system, as returned by the pagestat() system call. Needs
+// param.h.
+//
+// faultlat[] is a histogram of the CPU cycles taken to service
+// a page fault: faultlat[k] counts faults that took fewer than
+// FAULTLAT_MIN<<k cycles and, for k > 0, at least half that.
+// The last bucket also counts everything slower.
+#define FAULTLAT_MIN 1024
+
+struct pagestat {
+  int algo;           // system-wide policy, or NONE if paging is off
+  int policy;         // the policy the process follows
+  int pinned;         // 1 if the process is not paged
+  int limit;          // most pages it may keep in memory
+  int resident;       // pages the replacement policy tracks in memory
+  int arct2;          // ARC: of them, pages used again since they came in (T2)
+  int arctarget;      // ARC: pages used just once it aims to keep (T1)
+  uint64 faults;      // page faults taken
+  uint64 swapins;     // pages read back from the swap file
+  uint64 swapouts;    // pages written to the swap file
+  uint64 zswapins;    // pages decompressed from the zswap pool
+  uint64 zswapouts;   // pages compressed into the zswap pool
+  uint64 fillins;     // all-one-byte pages filled back in
+  uint64 fillouts;    // all-one-byte pages swapped out without I/O
+  uint64 rescues;     // pages faulted in before they were written out
+  uint64 evictions;   // pages chosen to be evicted
+  uint64 scans;       // memory pages looked at to choose them
+  uint64 rotations;   // used pages given another chance instead
+  uint64 sweeps;      // aging sweeps over the memory pages
+  uint64 ghosthits;   // faults on pages ARC remembered evicting
+  uint64 faultlat[NFAULTLAT];
+};
+
+// pagectl() operations. Each returns the attribute's old value.
+// Policies are SCFIFO, NFUA, LAPA, FIFO and ARC, from param.h.
+#define PAGECTL_PIN       1   // arg!=0: pin images exec'd from now on
+#define PAGECTL_LIMIT     2   // arg: most pages kept in memory
+#define PAGECTL_POLICY    3   // arg: policy, or NONE for the system-wide one
+#define PAGECTL_SYSPOLICY 4   // arg: system-wide policy
+#define PAGECTL_ZSWAP     5   // arg!=0: compress pages into memory before disk
+
+// Names of the policies, indexed by their numbers in param.h,
+// to initialize an array of strings with.
+#define PGPOLICY_NAMES { "NONE", "SCFIFO", "NFUA", "LAPA", "FIFO", "ARC" }
@@ -7,13 +7,21 @@
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGSIZE      250  // max data blocks in on-disk log (one header block)
+#define NBUF         (LOGSIZE+MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NDCACHE      64   // size of directory name cache
+#define NLOCKSTAT    64   // distinct spinlock names with statistics
+#define NVMA         16   // mmap() regions per process
 #define MAX_PSYC_PAGES  16  // maximum number of physical pages
 #define MAX_PAGED_PAGES 16  // maximum number of pages in swapfile
 #define MAX_TOTAL_PAGES 32  // maximum number of pages
+#define NZSWAP       64   // most pages in the compressed swap pool
+#define NLAUNDRY     32   // swapped-out pages waiting to be written
+#define NFAULTLAT    16   // buckets of the fault service time histogram
+#define NTRACE       1024 // trace events buffered per CPU
+#define NPROF        256  // profiling samples buffered per CPU
 
 #define INMEMORY     1
 #define PAGED        2
@@ -22,4 +30,6 @@
 #define SCFIFO       1
 #define NFUA         2
 #define LAPA         3
+#define FIFO         4
+#define ARC          5
 
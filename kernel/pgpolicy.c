@@ -0,0 +1,535 @@
+// Page replacement policies.
+//
+// A policy is a table of hooks, called by the pager in vm.c
+// as the pages of a paged process come and go:
+//   insert   page has come into memory
+//   access   page was used since the last age sweep
+//   age      a tick has passed, for each page in memory
+//   victim   choose the page to evict
+//   remove   page has left memory
+//   start    the policy takes over p, before its pages are
+//            inserted
+// Any hook but victim may be 0. A policy keeps its state in
+// struct page, p->scfifo and p->arc.
+//
+// A process follows the system-wide policy unless it has
+// chosen one of its own with pagectl(). p->pgops is the policy
+// that tracks p's pages now; pgsync() hands them over to the
+// policy p should follow. Only p itself calls pgsync(), so the
+// system-wide policy can change without touching the paging
+// state of other processes. All of a process's paging state,
+// policy state included, is under its p->pglock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "paging.h"
+
+#if SWAP_ALGO != NONE
+
+struct pgops {
+  char *name;
+  void (*insert)(struct proc*, struct page*);
+  void (*access)(struct proc*, struct page*);
+  void (*age)(struct proc*, struct page*);
+  struct page* (*victim)(struct proc*);
+  void (*remove)(struct proc*, struct page*);
+  void (*start)(struct proc*);
+};
+
+int pgdefault = SWAP_ALGO;   // the system-wide policy
+
+static int
+slot(struct proc *p, struct page *page)
+{
+  return page - p->memory_pages;
+}
+
+static pte_t*
+pagepte(struct proc *p, struct page *page)
+{
+  return walk(p->pagetable, page->va, 0);
+}
+
+// Append page to p's FIFO, as the newest page.
+static void
+fifo_insert(struct proc *p, struct page *page)
+{
+  struct scfifo *scfifo = &p->scfifo[slot(p, page)];
+
+  scfifo->position = slot(p, page);
+  scfifo->newer = 0;
+  scfifo->older = p->newest;
+  if(p->newest != 0)
+    p->newest->newer = scfifo;
+  p->newest = scfifo;
+  if(p->oldest == 0)
+    p->oldest = scfifo;
+}
+
+static void
+fifo_remove(struct proc *p, struct page *page)
+{
+  struct scfifo *scfifo = &p->scfifo[slot(p, page)];
+
+  if(scfifo->older)
+    scfifo->older->newer = scfifo->newer;
+  else
+    p->oldest = scfifo->newer;
+  if(scfifo->newer)
+    scfifo->newer->older = scfifo->older;
+  else
+    p->newest = scfifo->older;
+  scfifo->newer = 0;
+  scfifo->older = 0;
+}
+
+// the page that came in first.
+static struct page*
+fifo_victim(struct proc *p)
+{
+  PGCOUNT(p, scans);
+  return &p->memory_pages[p->oldest->position];
+}
+
+// second chance FIFO: the oldest page that hasn't been used
+// since it last reached the front of the FIFO.
+static struct page*
+scfifo_victim(struct proc *p)
+{
+  struct page *page;
+  pte_t *pte;
+
+  for(;;){
+    page = fifo_victim(p);
+    pte = pagepte(p, page);
+    if((*pte & PTE_A) == 0)
+      return page;
+    *pte &= ~PTE_A;
+    PGCOUNT(p, rotations);
+    fifo_remove(p, page);
+    fifo_insert(p, page);
+  }
+}
+
+// NFUA and LAPA both age a 64-bit counter per page, shifting
+// in a 1 each tick the page was used.
+static void
+counter_age(struct proc *p, struct page *page)
+{
+  page->counter >>= 1;
+}
+
+static void
+counter_access(struct proc *p, struct page *page)
+{
+  page->counter |= 0x8000000000000000;
+}
+
+static void
+nfua_insert(struct proc *p, struct page *page)
+{
+  page->counter = 0;
+}
+
+// not frequently used: the smallest counter.
+static struct page*
+nfua_victim(struct proc *p)
+{
+  struct page *page, *min_page = 0;
+
+  for(page = p->memory_pages; page < &p->memory_pages[MAX_PSYC_PAGES]; page++){
+    if(page->status != INMEMORY)
+      continue;
+    PGCOUNT(p, scans);
+    if(min_page == 0 || page->counter < min_page->counter)
+      min_page = page;
+  }
+  if(min_page == 0)
+    panic("no min page");
+  return min_page;
+}
+
+static uint
+ones(uint64 counter)
+{
+  uint n = 0;
+
+  for(; counter != 0; counter >>= 1)
+    n += counter & 1;
+  return n;
+}
+
+static void
+lapa_insert(struct proc *p, struct page *page)
+{
+  page->counter = 0xFFFFFFFFFFFFFFFF;
+}
+
+// least accessed: the fewest 1s in its counter, then the
+// smallest counter.
+static struct page*
+lapa_victim(struct proc *p)
+{
+  struct page *page, *min_page = 0;
+  uint n, min_ones = 100;
+
+  for(page = p->memory_pages; page < &p->memory_pages[MAX_PSYC_PAGES]; page++){
+    if(page->status != INMEMORY)
+      continue;
+    PGCOUNT(p, scans);
+    n = ones(page->counter);
+    if(n < min_ones || (n == min_ones && page->counter < min_page->counter)){
+      min_page = page;
+      min_ones = n;
+    }
+  }
+  if(min_page == 0)
+    panic("no min page");
+  return min_page;
+}
+
+// ARC, in its clock form, CAR (Bansal and Modha): pages not
+// used since they came in are on clock T1, and pages used
+// again are on clock T2. The vas of pages recently evicted
+// from each are kept as ghosts, in b1 and b2. A fault on a b1
+// ghost means T1 is too small, and one on a b2 ghost that T2
+// is; either way target, the pages T1 should hold, moves, and
+// the page comes back on T2. So the policy balances recency
+// against frequency by itself, and a scan through many pages
+// only churns T1. Pages along a clock are in order of
+// page->counter, and PTE_A is the reference bit.
+//
+// The access that faults a page in sets PTE_A too, so a T1
+// page only moves to T2 if it is used after the sweep has
+// cleared that first reference.
+
+#define T1    1
+#define T2    2
+#define SWEPT 4   // T1 page's first reference has been cleared
+
+static void
+arc_start(struct proc *p)
+{
+  memset(&p->arc, 0, sizeof(p->arc));
+}
+
+// Move page to the tail of clock.
+static void
+arc_append(struct proc *p, struct page *page, int clock)
+{
+  struct arc *a = &p->arc;
+  uchar *c = &a->clock[slot(p, page)];
+
+  if(*c & T1)
+    a->nt1--;
+  else if(*c & T2)
+    a->nt2--;
+  *c = clock;
+  if(clock & T1)
+    a->nt1++;
+  else
+    a->nt2++;
+  page->counter = ++a->stamp;
+}
+
+// the page at the head of clock.
+static struct page*
+arc_head(struct proc *p, int clock)
+{
+  struct page *page, *head = 0;
+
+  for(page = p->memory_pages; page < &p->memory_pages[MAX_PSYC_PAGES]; page++){
+    if(page->status == INMEMORY && (p->arc.clock[slot(p, page)] & clock) &&
+       (head == 0 || page->counter < head->counter))
+      head = page;
+  }
+  if(head == 0)
+    panic("arc_head");
+  return head;
+}
+
+// Where va is in ghost list g of n entries, or -1.
+static int
+ghostfind(uint64 *g, int n, uint64 va)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(g[i] == va)
+      return i;
+  return -1;
+}
+
+static void
+ghostdel(uint64 *g, int *n, int i)
+{
+  memmove(&g[i], &g[i+1], (*n - i - 1) * sizeof(g[0]));
+  (*n)--;
+}
+
+// Add va to ghost list g as its newest entry.
+static void
+ghostadd(uint64 *g, int *n, uint64 va)
+{
+  if(*n == MAX_PSYC_PAGES)
+    ghostdel(g, n, 0);
+  g[(*n)++] = va;
+}
+
+static void
+arc_insert(struct proc *p, struct page *page)
+{
+  struct arc *a = &p->arc;
+  int c = p->pglimit;
+  int i, d;
+
+  if((i = ghostfind(a->b1, a->nb1, page->va)) >= 0){
+    d = a->nb2 / a->nb1;
+    a->target += d > 1 ? d : 1;
+    if(a->target > c)
+      a->target = c;
+    ghostdel(a->b1, &a->nb1, i);
+    arc_append(p, page, T2);
+    PGCOUNT(p, ghosthits);
+  } else if((i = ghostfind(a->b2, a->nb2, page->va)) >= 0){
+    d = a->nb1 / a->nb2;
+    a->target -= d > 1 ? d : 1;
+    if(a->target < 0)
+      a->target = 0;
+    ghostdel(a->b2, &a->nb2, i);
+    arc_append(p, page, T2);
+    PGCOUNT(p, ghosthits);
+  } else {
+    // keep T1 with its ghosts within c pages, and
+    // everything within 2c.
+    if(a->nb1 > 0 && a->nt1 + a->nb1 >= c)
+      ghostdel(a->b1, &a->nb1, 0);
+    else if(a->nb2 > 0 && a->nt1 + a->nt2 + a->nb1 + a->nb2 >= 2*c)
+      ghostdel(a->b2, &a->nb2, 0);
+    arc_append(p, page, T1);
+  }
+}
+
+// Sweep T1 while it holds more than target pages, T2
+// otherwise. A used page at the head of either clock moves
+// to the tail of T2, or of T1 if that was its first use; the
+// first unused one is evicted, and becomes a ghost.
+static struct page*
+arc_victim(struct proc *p)
+{
+  struct arc *a = &p->arc;
+  struct page *page;
+  pte_t *pte;
+  int clock;
+
+  for(;;){
+    if(a->nt2 == 0 || (a->nt1 > 0 && a->nt1 >= (a->target > 1 ? a->target : 1)))
+      clock = T1;
+    else
+      clock = T2;
+    page = arc_head(p, clock);
+    PGCOUNT(p, scans);
+    pte = pagepte(p, page);
+    if((*pte & PTE_A) == 0)
+      break;
+    *pte &= ~PTE_A;
+    PGCOUNT(p, rotations);
+    if(clock == T1 && (a->clock[slot(p, page)] & SWEPT) == 0)
+      arc_append(p, page, T1|SWEPT);
+    else
+      arc_append(p, page, T2);
+  }
+  a->clock[slot(p, page)] = 0;
+  if(clock == T1){
+    a->nt1--;
+    ghostadd(a->b1, &a->nb1, page->va);
+  } else {
+    a->nt2--;
+    ghostadd(a->b2, &a->nb2, page->va);
+  }
+  return page;
+}
+
+// page is gone without being evicted: it leaves no ghost.
+static void
+arc_remove(struct proc *p, struct page *page)
+{
+  struct arc *a = &p->arc;
+  uchar *c = &a->clock[slot(p, page)];
+
+  if(*c & T1)
+    a->nt1--;
+  else if(*c & T2)
+    a->nt2--;
+  *c = 0;
+}
+
+static struct pgops scfifo_ops = {
+  "scfifo", fifo_insert, 0, 0, scfifo_victim, fifo_remove, 0,
+};
+
+static struct pgops nfua_ops = {
+  "nfua", nfua_insert, counter_access, counter_age, nfua_victim, 0, 0,
+};
+
+static struct pgops lapa_ops = {
+  "lapa", lapa_insert, counter_access, counter_age, lapa_victim, 0, 0,
+};
+
+static struct pgops fifo_ops = {
+  "fifo", fifo_insert, 0, 0, fifo_victim, fifo_remove, 0,
+};
+
+static struct pgops arc_ops = {
+  "arc", arc_insert, 0, 0, arc_victim, arc_remove, arc_start,
+};
+
+static struct pgops *policies[] = {
+[SCFIFO]  &scfifo_ops,
+[NFUA]    &nfua_ops,
+[LAPA]    &lapa_ops,
+[FIFO]    &fifo_ops,
+[ARC]     &arc_ops,
+};
+
+// The hooks of policy, or 0 if there is no such policy.
+static struct pgops*
+policyops(int policy)
+{
+  if(policy <= NONE || policy >= NELEM(policies))
+    return 0;
+  return policies[policy];
+}
+
+// The policy p follows.
+int
+pgpolicy(struct proc *p)
+{
+  return p->pgpolicy != NONE ? p->pgpolicy : pgdefault;
+}
+
+// Hand p's pages in memory over to the policy p follows, if
+// that isn't the one tracking them. The new policy sees them
+// as just inserted, in slot order.
+void
+pgsync(struct proc *p)
+{
+  struct pgops *ops = policyops(pgpolicy(p));
+  struct page *page;
+
+  if(p->pgops == ops)
+    return;
+  if(p->pgops && p->pgops->remove){
+    for(page = p->memory_pages; page < &p->memory_pages[MAX_PSYC_PAGES]; page++)
+      if(page->status == INMEMORY)
+        p->pgops->remove(p, page);
+  }
+  if(ops->start)
+    ops->start(p);
+  for(page = p->memory_pages; page < &p->memory_pages[MAX_PSYC_PAGES]; page++){
+    if(page->status == INMEMORY && ops->insert)
+      ops->insert(p, page);
+  }
+  p->pgops = ops;
+}
+
+void
+pginsert(struct proc *p, struct page *page)
+{
+  if(p->pgops->insert)
+    p->pgops->insert(p, page);
+}
+
+void
+pgremove(struct proc *p, struct page *page)
+{
+  if(p->pgops->remove)
+    p->pgops->remove(p, page);
+}
+
+struct page*
+pgvictim(struct proc *p)
+{
+  PGCOUNT(p, evictions);
+  return p->pgops->victim(p);
+}
+
+// Fill in the parts of *st that belong to the policy
+// tracking p's pages.
+void
+pgpolicystat(struct proc *p, struct pagestat *st)
+{
+  if(p->pgops == &arc_ops){
+    st->arct2 = p->arc.nt2;
+    st->arctarget = p->arc.target;
+  }
+}
+
+// Age p's pages in memory, for the policies that age them,
+// and tell them which pages were used.
+// Caller must hold p->pglock.
+void
+update_counters(struct proc *p)
+{
+  struct pgops *ops = p->pgops;
+  struct page *page;
+  pte_t *pte;
+
+  if(ops == 0 || ops->age == 0)
+    return;
+  PGCOUNT(p, sweeps);
+  for(page = p->memory_pages; page < &p->memory_pages[MAX_PSYC_PAGES]; page++){
+    if(page->status != INMEMORY)
+      continue;
+    ops->age(p, page);
+    pte = pagepte(p, page);
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      if(ops->access)
+        ops->access(p, page);
+    }
+  }
+}
+
+// Make p follow policy, or the system-wide policy if policy
+// is NONE. Returns the old setting, or -1 if policy is unknown.
+int
+setpgpolicy(struct proc *p, int policy)
+{
+  int old;
+
+  if(policy != NONE && policyops(policy) == 0)
+    return -1;
+  old = p->pgpolicy;
+  p->pgpolicy = policy;
+  acquiresleep(&p->pglock);
+  pgsync(p);
+  releasesleep(&p->pglock);
+  return old;
+}
+
+// Change the system-wide policy. Other processes that follow
+// it switch the next time they page.
+// Returns the old policy, or -1 if policy is unknown.
+int
+setsyspolicy(int policy)
+{
+  int old;
+
+  if(policyops(policy) == 0)
+    return -1;
+  old = pgdefault;
+  pgdefault = policy;
+  acquiresleep(&myproc()->pglock);
+  pgsync(myproc());
+  releasesleep(&myproc()->pglock);
+  return old;
+}
+
+#endif
@@ -3,8 +3,11 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
+#include "paging.h"
+#include "trace.h"
 
 struct cpu cpus[NCPU];
 
@@ -12,11 +15,15 @@ struct proc proc[NPROC];
 
 struct proc *initproc;
 
+// paging statistics of every process there has been.
+struct pgcount pgtotal;
+
 int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,6 +33,35 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// Per-CPU queues of RUNNABLE processes, in FIFO order.
+// A RUNNABLE process is on exactly one queue until a
+// scheduler takes it off to run it. A queue's lock may be
+// acquired while holding a p->lock, never the other way round.
+struct runq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc *tail;
+  int n;              // length; may be read without lock as a hint
+  int idle;           // owning CPU is waiting for an interrupt
+} runq[NCPU];
+
+// Processes in sleep(), hashed by channel so that wakeup()
+// only visits processes sleeping on channels in one bucket.
+// Lock order: the lock passed to sleep(), then the bucket
+// lock, then p->lock.
+#define NWAITQ 64
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;  // oldest sleeper first
+} waitq[NWAITQ];
+
+static struct waitq*
+chanq(void *chan)
+{
+  return &waitq[((uint64)chan >> 4) % NWAITQ];
+}
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -48,11 +84,17 @@ void
 procinit(void)
 {
   struct proc *p;
+  int i;
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
+      initsleeplock(&p->pglock, "pglock");
       p->state = UNUSED;
       p->kstack = KSTACK((int) (p - proc));
   }
@@ -124,6 +166,12 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->num_of_phys_pages = 0;
+  memset(&p->pgc, 0, sizeof(p->pgc));
+  p->pinned = 0;
+  p->pinexec = 0;
+  p->pglimit = MAX_PSYC_PAGES;
+  p->pgpolicy = NONE;
+  p->pgops = 0;
   p->state = USED;
 
   // Allocate a trapframe page.
@@ -133,6 +181,15 @@ found:
     return 0;
   }
 
+  // Allocate the page shared with user space.
+  if((p->usyscall = (struct usyscall *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->usyscall, 0, PGSIZE);
+  p->usyscall->pid = p->pid;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -159,6 +216,12 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
+  if(p->ioring)
+    kfree((void*)p->ioring);
+  p->ioring = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   #if SWAP_ALGO != NONE
@@ -206,6 +269,16 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the usyscall page just below the trapframe page,
+  // readable but not writable by user code.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -214,8 +287,13 @@ proc_pagetable(struct proc *p)
 void
 proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
+  pte_t *pte;
+
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
+  if((pte = walk(pagetable, IORING, 0)) != 0 && (*pte & PTE_V))
+    uvmunmap(pagetable, IORING, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -253,7 +331,32 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  // init and the shells it starts are not paged.
+  p->pinned = 1;
+  p->pinexec = 1;
+
+  p->cpu = 0;
+  setrunnable(p);
+
+  release(&p->lock);
+}
+
+// Start a kernel process that runs fn, which never returns.
+// fn starts out holding its p->lock, as forkret() does.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->context.ra = (uint64)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->pinned = 1;
+  p->pinexec = 1;
+
+  p->cpu = 0;
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -268,6 +371,14 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
+    // the heap must not grow into mmap() regions, nor
+    // need more swap file slots than there are.
+    if(vmaclash(p, PGROUNDUP(sz), sz + n))
+      return -1;
+    #if SWAP_ALGO != NONE
+      if(!p->pinned && PGROUNDUP(sz + n) + vmaprivate(p) > pagebudget(p))
+        return -1;
+    #endif
     if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
       return -1;
     }
@@ -283,6 +394,9 @@ growproc(int n)
     child->counter = parent->counter;
     child->va = parent->va;
     child->status = parent->status;
+    child->zhandle = parent->zhandle;
+    if (child->zhandle)
+      zswap_dup(child->zhandle);
   }
 
   void copyScfifoBase(struct proc* parent, struct proc *child) {
@@ -320,9 +434,9 @@ growproc(int n)
     struct page *source;
     struct page *target;
 
-    #if SWAP_ALGO == SCFIFO
-      copyScfifoBase(parent, child);
-    #endif
+    copyScfifoBase(parent, child);
+    child->pgops = parent->pgops;
+    child->arc = parent->arc;
     child->num_of_phys_pages = parent->num_of_phys_pages;
     for (int i = 0; i < MAX_PSYC_PAGES; i++) {
       source = &parent->memory_pages[i];
@@ -331,9 +445,7 @@ growproc(int n)
       source = &parent->swapfile_pages[i];
       target = &child->swapfile_pages[i];
       copypage(source, target);
-      #if SWAP_ALGO == SCFIFO
-        copyScfifo(parent, child, i);
-      #endif
+      copyScfifo(parent, child, i);
     }
   }
 #endif
@@ -360,6 +472,12 @@ fork(void)
   }
   np->sz = p->sz;
 
+  if(vmacopy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -374,14 +492,22 @@ fork(void)
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
+  np->pinned = p->pinned;
+  np->pinexec = p->pinexec;
+  np->pglimit = p->pglimit;
+  np->pgpolicy = p->pgpolicy;
+
   pid = np->pid;
 
   release(&np->lock);
 
   #if SWAP_ALGO != NONE
-    int sh_init = sh_or_init(p);
-    if (sh_init) {
+    if (!p->pinned) {
       createSwapFile(np);
+      acquiresleep(&p->pglock);
+      // the child gets a copy of the swap file, so it
+      // has to hold all of p's swapped-out pages.
+      laundry_sync(p);
       copypaging(p, np);
       char *mem = kalloc();
       for (int i = 0; i < MAX_PAGED_PAGES; i++) {
@@ -389,6 +515,7 @@ fork(void)
         writeToSwapFile(np, mem, i * PGSIZE, PGSIZE);
       }
       kfree(mem);
+      releasesleep(&p->pglock);
     }
   #endif
  
@@ -400,7 +527,8 @@ fork(void)
 
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->cpu = cpuid();
+  setrunnable(np);
   release(&np->lock);
   
   return pid;
@@ -431,10 +559,13 @@ exit(int status)
 
   if(p == initproc)
     panic("init exiting");
+
+  // write back and unmap mmap() regions while the
+  // paging state that tracks their pages still exists.
+  vmafree(p);
   #if SWAP_ALGO != NONE
-    if (sh_or_init(p)) {
-      removeSwapFile(p);
-    }
+    laundry_drop(p);
+    removeSwapFile(p);
   #endif
 
   // Close all open files.
@@ -520,41 +651,138 @@ wait(uint64 addr)
   }
 }
 
+// Mark p RUNNABLE and append it to the run queue of the
+// CPU it last ran on, where its cache is most likely warm.
+// If that CPU is idle it would not notice p until its next
+// idle check, so queue p on this CPU instead.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *rq = &runq[p->cpu];
+
+  p->state = RUNNABLE;
+  p->rqnext = 0;
+  acquire(&rq->lock);
+  if(rq->idle && p->cpu != cpuid()){
+    release(&rq->lock);
+    p->cpu = cpuid();
+    rq = &runq[p->cpu];
+    acquire(&rq->lock);
+  }
+  if(rq->tail)
+    rq->tail->rqnext = p;
+  else
+    rq->head = p;
+  rq->tail = p;
+  rq->n++;
+  release(&rq->lock);
+}
+
+// Take the first process off rq, or return 0 if it is empty.
+static struct proc*
+runqpop(struct runq *rq)
+{
+  struct proc *p;
+
+  if(__atomic_load_n(&rq->n, __ATOMIC_RELAXED) == 0)
+    return 0;
+  acquire(&rq->lock);
+  if((p = rq->head) != 0){
+    rq->head = p->rqnext;
+    if(rq->head == 0)
+      rq->tail = 0;
+    rq->n--;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Wait for an interrupt if this CPU's run queue is still
+// empty. Interrupts stay off until the queue has been marked
+// idle, so a wakeup from an interrupt handler on this CPU
+// can't slip in between the check and the wfi.
+static void
+idle(int id)
+{
+  struct runq *rq = &runq[id];
+
+  intr_off();
+  acquire(&rq->lock);
+  if(rq->head == 0){
+    rq->idle = 1;
+    release(&rq->lock);
+    timer_idle();
+    wfi();
+    acquire(&rq->lock);
+    rq->idle = 0;
+  }
+  release(&rq->lock);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take a process off this CPU's run queue or, if it
+//    is empty, steal one from another CPU's queue.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
+// With nothing to run, the CPU sleeps until an interrupt.
 void
 scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  int i;
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-        #if (SWAP_ALGO == LAPA || SWAP_ALGO == NFUA)
+    p = runqpop(&runq[id]);
+    for(i = 1; p == 0 && i < NCPU; i++)
+      p = runqpop(&runq[(id + i) % NCPU]);
+    if(p == 0){
+      idle(id);
+      continue;
+    }
+
+    timer_slice();
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      p->cpu = id;
+      p->usyscall->ticks = timer_now() / TICK_CYCLES;
+      c->proc = p;
+      trace(TR_RUN, 0, 0);
+      swtch(&c->context, &p->context);
+      trace(TR_STOP, p->state, 0);
+      #if SWAP_ALGO != NONE
+        // age the page counters at most once per tick,
+        // so aging follows time rather than how often
+        // the process gives up the CPU. If p stopped in the
+        // middle of paging, as when it waits for swap I/O,
+        // try again the next time. Only p itself waits for
+        // its pglock, and it can't run while we hold p->lock,
+        // so there is no one to wake, and wakeup() can't be
+        // called with p->lock held anyway.
+        if(!p->pinned && timer_now() >= p->agetime &&
+           tryacquiresleep(&p->pglock)){
           update_counters(p);
-        #endif
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+          releasesleepnowake(&p->pglock);
+          p->agetime = timer_now() + TICK_CYCLES;
+        }
+      #endif
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
     }
+    release(&p->lock);
   }
 }
 
@@ -591,7 +819,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -623,15 +851,23 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = chanq(chan);
+  struct proc **pp;
   
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
-
+  // Must join chan's wait queue and acquire
+  // p->lock in order to change p->state and then
+  // call sched. Once we are on the queue and hold
+  // p->lock, we can be guaranteed that we won't
+  // miss any wakeup (wakeup locks the queue, then
+  // p->lock), so it's okay to release lk.
+
+  acquire(&wq->lock);
+  for(pp = &wq->head; *pp; pp = &(*pp)->wqnext)
+    ;
+  p->wqnext = 0;
+  *pp = p;
   acquire(&p->lock);  //DOC: sleeplock1
+  release(&wq->lock);
   release(lk);
 
   // Go to sleep.
@@ -642,28 +878,57 @@ sleep(void *chan, struct spinlock *lk)
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  acquire(&wq->lock);
+  for(pp = &wq->head; *pp != p; pp = &(*pp)->wqnext)
+    ;
+  *pp = p->wqnext;
+  release(&wq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
-// Wake up all processes sleeping on chan.
+// Wake up processes sleeping on chan: all of them, or
+// just the one that has waited longest if one is set.
 // Must be called without any p->lock.
-void
-wakeup(void *chan)
+static void
+wakechan(void *chan, int one)
 {
+  struct waitq *wq = chanq(chan);
   struct proc *p;
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  acquire(&wq->lock);
+  for(p = wq->head; p && !(one && woken); p = p->wqnext) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        setrunnable(p);
+        woken = 1;
       }
       release(&p->lock);
     }
   }
+  release(&wq->lock);
+}
+
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void
+wakeup(void *chan)
+{
+  wakechan(chan, 0);
+}
+
+// Wake up the process that has slept longest on chan,
+// for resources that only one waiter can use.
+// Must be called without any p->lock.
+void
+wakeone(void *chan)
+{
+  wakechan(chan, 1);
 }
 
 // Kill the process with the given pid.
@@ -680,7 +945,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p);
       }
       release(&p->lock);
       return 0;
@@ -739,6 +1004,85 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+static void
+pgcountcopy(struct pagestat *st, struct pgcount *c)
+{
+  st->faults = c->faults;
+  st->swapins = c->swapins;
+  st->swapouts = c->swapouts;
+  st->zswapins = c->zswapins;
+  st->zswapouts = c->zswapouts;
+  st->fillins = c->fillins;
+  st->fillouts = c->fillouts;
+  st->rescues = c->rescues;
+  st->evictions = c->evictions;
+  st->scans = c->scans;
+  st->rotations = c->rotations;
+  st->sweeps = c->sweeps;
+  st->ghosthits = c->ghosthits;
+  memmove(st->faultlat, c->faultlat, sizeof(st->faultlat));
+}
+
+// Fill in *st with the paging statistics of process pid, or
+// of the caller if pid is 0. If pid is -1, they are totals
+// over every process since boot, and resident is the pages
+// in memory of the processes there are now.
+// Returns -1 if there is no process pid.
+int
+pagestats(int pid, struct pagestat *st)
+{
+  struct proc *p;
+  struct pgcount c;
+  uint64 *src, *dst;
+  int i;
+
+  memset(st, 0, sizeof(*st));
+#if SWAP_ALGO != NONE
+  st->algo = pgdefault;
+#else
+  st->algo = NONE;
+#endif
+  st->policy = st->algo;
+
+  if(pid == -1){
+    st->pinned = SWAP_ALGO == NONE;
+    st->limit = MAX_PSYC_PAGES;
+    for(p = proc; p < &proc[NPROC]; p++){
+      acquire(&p->lock);
+      if(p->state != UNUSED)
+        st->resident += p->num_of_phys_pages;
+      release(&p->lock);
+    }
+    src = (uint64*)&pgtotal;
+    dst = (uint64*)&c;
+    for(i = 0; i < sizeof(c) / sizeof(uint64); i++)
+      dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    pgcountcopy(st, &c);
+    return 0;
+  }
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED)
+      break;
+    release(&p->lock);
+  }
+  if(p == &proc[NPROC])
+    return -1;
+#if SWAP_ALGO != NONE
+  st->policy = pgpolicy(p);
+  pgpolicystat(p, st);
+#endif
+  st->pinned = SWAP_ALGO == NONE || p->pinned;
+  st->limit = p->pglimit;
+  st->resident = p->num_of_phys_pages;
+  pgcountcopy(st, &p->pgc);
+  release(&p->lock);
+  return 0;
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -765,6 +1109,15 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    printf(" faults %d", (int)p->pgc.faults);
+#if SWAP_ALGO != NONE
+    if(!p->pinned)
+      printf(" pages %d/%d in %d out %d evict %d",
+             p->num_of_phys_pages, p->pglimit,
+             (int)(p->pgc.swapins + p->pgc.zswapins + p->pgc.fillins + p->pgc.rescues),
+             (int)(p->pgc.swapouts + p->pgc.zswapouts + p->pgc.fillouts),
+             (int)p->pgc.evictions);
+#endif
     printf("\n");
   }
 }
@@ -773,29 +1126,28 @@ procdump(void)
   void clearpages(struct proc *p) {
     struct page *memory_page;
     struct page *swapfile_page;
-    #if SWAP_ALGO == SCFIFO
-      struct scfifo *scfifo;
-      p->oldest = 0;
-      p->newest = 0;
-    #endif
-    if (sh_or_init(p)) {
-      p->num_of_phys_pages = 0;
-      for (int i = 0; i < MAX_PSYC_PAGES; i++) {
-        memory_page = &p->memory_pages[i];
-        swapfile_page = &p->swapfile_pages[i];
-        memory_page->counter = 0;
-        memory_page->va = 0;
-        memory_page->status = UNUSED;
-        swapfile_page->counter = 0;
-        swapfile_page->va = 0;
-        swapfile_page->status = UNUSED;
-        #if SWAP_ALGO == SCFIFO
-          scfifo = &p->scfifo[i];
-          scfifo->position = 0;
-          scfifo->newer = 0;
-          scfifo->older = 0;
-        #endif
+    struct scfifo *scfifo;
+    p->oldest = 0;
+    p->newest = 0;
+    p->pgops = 0;
+    p->num_of_phys_pages = 0;
+    for (int i = 0; i < MAX_PSYC_PAGES; i++) {
+      memory_page = &p->memory_pages[i];
+      swapfile_page = &p->swapfile_pages[i];
+      memory_page->counter = 0;
+      memory_page->va = 0;
+      memory_page->status = UNUSED;
+      swapfile_page->counter = 0;
+      swapfile_page->va = 0;
+      swapfile_page->status = UNUSED;
+      if (swapfile_page->zhandle) {
+        zswap_free(swapfile_page->zhandle);
+        swapfile_page->zhandle = 0;
       }
+      scfifo = &p->scfifo[i];
+      scfifo->position = 0;
+      scfifo->newer = 0;
+      scfifo->older = 0;
     }
   }
 
@@ -83,6 +83,8 @@ struct page {
   uint64 counter;
   uint64 va;
   int status;
+  int zhandle;       // swapped out page's place in the zswap pool, or 0
+  int laundry;       // its frame's place in the laundry queue, or 0; under laundry.lock
 };
 
 struct scfifo {
@@ -91,6 +93,63 @@ struct scfifo {
   int position;
 };
 
+// State of the ARC policy, see pgpolicy.c.
+struct arc {
+  int target;                   // pages the T1 clock should hold
+  int nt1, nt2;                 // pages on the T1 and T2 clocks
+  uchar clock[MAX_PSYC_PAGES];  // which clock each memory page is on
+  uint64 stamp;                 // orders pages along their clock
+  int nb1, nb2;                 // ghosts in b1 and b2
+  uint64 b1[MAX_PSYC_PAGES];    // vas evicted from T1, oldest first
+  uint64 b2[MAX_PSYC_PAGES];    // vas evicted from T2, oldest first
+};
+
+// Paging statistics, of one process or of the whole system,
+// see sys_pagestat().
+struct pgcount {
+  uint64 faults;               // page faults taken
+  uint64 swapins;              // pages read back from the swap file
+  uint64 swapouts;             // pages written to the swap file
+  uint64 zswapins;             // pages decompressed from the zswap pool
+  uint64 zswapouts;            // pages compressed into the zswap pool
+  uint64 fillins;              // all-one-byte pages filled back in
+  uint64 fillouts;             // all-one-byte pages kept in their PTE
+  uint64 rescues;              // pages faulted in before they were written
+  uint64 evictions;            // pages chosen to be evicted
+  uint64 scans;                // memory pages looked at to choose them
+  uint64 rotations;            // used pages given another chance instead
+  uint64 sweeps;               // aging sweeps over the memory pages
+  uint64 ghosthits;            // faults on pages ARC remembered evicting
+  uint64 faultlat[NFAULTLAT];  // faults by cycles taken, see paging.h
+};
+
+// Count one event in field f of p's paging statistics, and
+// of the system's.
+#define PGCOUNT(p, f) do { \
+  (p)->pgc.f++; \
+  __atomic_fetch_add(&pgtotal.f, 1, __ATOMIC_RELAXED); \
+} while(0)
+
+
+// Data the kernel shares read-only with each process, in
+// the page at USYSCALL, so that user code can get at it
+// without a system call. The stubs in user/usys.pl read
+// these fields at fixed offsets.
+struct usyscall {
+  int pid;                     // offset 0: process ID
+  uint ticks;                  // offset 4: clock ticks since boot
+};
+
+// A region of user memory set up by mmap().
+// Its pages are mapped lazily, by vmafault().
+struct vma {
+  uint64 addr;                 // page-aligned start
+  uint64 len;                  // length in bytes, a page multiple; 0 if unused
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE, MAP_ANONYMOUS
+  struct file *f;              // file mapped, or 0 if anonymous
+  uint off;                    // offset in f of addr
+};
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
@@ -104,6 +163,13 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // CPU whose run queue p joins when RUNNABLE
+
+  // the run queue's lock must be held when using this:
+  struct proc *rqnext;         // Next process on the run queue
+
+  // the wait queue's lock must be held when using this:
+  struct proc *wqnext;         // Next process sleeping in the same bucket
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -113,19 +179,40 @@ struct proc {
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  struct usyscall *usyscall;   // data page shared with user space
+  struct ioring *ioring;       // I/O ring shared with user space, or 0
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct vma vma[NVMA];        // mmap() regions
   char name[16];               // Process name (debugging)
+  int fsops;                   // log operations open and inodes locked
 
   uint num_of_phys_pages;      // Number of physical pages for the process
 
+  // paging attributes, see pagectl().
+  int pinned;                  // this image's pages are never paged out
+  int pinexec;                 // pinned for images exec'd from now on
+  int pglimit;                 // most pages kept in memory, if not pinned
+  int pgpolicy;                // replacement policy, NONE for the system's
+  struct pgops *pgops;         // policy tracking the pages in memory
+
   struct file *swapFile;
 
+  // p->pglock must be held to use num_of_phys_pages, pgops
+  // and the pages and policy state below. A fault holds it
+  // while it waits for swap I/O. Only p itself ever waits for
+  // it (see the scheduler's aging).
+  struct sleeplock pglock;
   struct page memory_pages[MAX_PSYC_PAGES];
   struct page swapfile_pages[MAX_PAGED_PAGES];
   struct scfifo scfifo[MAX_PSYC_PAGES];
 
   struct scfifo *newest;
   struct scfifo *oldest;
+  struct arc arc;
+
+  uint64 agetime;              // when to next age the page counters
+
+  struct pgcount pgc;          // paging statistics
 };
@@ -0,0 +1,147 @@
+// Sampling profiler.
+//
+// While profiling is on, the timer interrupts each CPU at
+// least every PROF_CYCLES (see timer_sampling()), and
+// profintr() records where the interrupted code was, user or
+// kernel, in a ring of that CPU's. As with the event trace
+// (trace.c), each ring has one writer, its CPU with interrupts
+// off, and one reader, a profread() holding prof.lock, so the
+// rings need no lock of their own. A full ring drops samples
+// and counts them.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "prof.h"
+#include "defs.h"
+
+#define PROF_CYCLES (TICK_CYCLES / 100)   // sample period
+#define PROF_POLL   (TICK_CYCLES / 10)    // how often profread() looks
+
+struct profring {
+  uint head;                    // next slot to write
+  uint tail;                    // next slot to read
+  uint lost;                    // samples dropped
+  uint64 next;                  // when to take the next sample
+  struct profsample s[NPROF];
+};
+
+struct {
+  struct sleeplock lock;        // one reader at a time
+  int on;
+  struct profring ring[NCPU];
+} prof;
+
+void
+profinit(void)
+{
+  initsleeplock(&prof.lock, "prof");
+}
+
+// Called from the timer interrupt, on the interrupted code's
+// pc, with user set if it was user code.
+void
+profintr(uint64 pc, int user)
+{
+  struct profring *r;
+  struct profsample *s;
+  struct proc *p;
+  uint64 now;
+  uint head;
+
+  if(!__atomic_load_n(&prof.on, __ATOMIC_RELAXED))
+    return;
+  r = &prof.ring[cpuid()];
+  now = timer_now();
+  if(now < r->next)
+    return;
+  r->next = now + PROF_CYCLES;
+  head = r->head;
+  if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == NPROF){
+    __atomic_fetch_add(&r->lost, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  s = &r->s[head % NPROF];
+  p = myproc();
+  s->pc = pc;
+  s->pid = p ? p->pid : 0;
+  s->cpu = cpuid();
+  s->user = user;
+  if(p && user)
+    safestrcpy(s->name, p->name, sizeof(s->name));
+  else
+    s->name[0] = 0;
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Turn profiling on or off. Returns the old setting.
+int
+profctl(int on)
+{
+  int cpu;
+
+  on = on != 0;
+  if(on && !__atomic_load_n(&prof.on, __ATOMIC_RELAXED)){
+    for(cpu = 0; cpu < NCPU; cpu++)
+      __atomic_store_n(&prof.ring[cpu].lost, 0, __ATOMIC_RELAXED);
+  }
+  timer_sampling(on ? PROF_CYCLES : 0);
+  return __atomic_exchange_n(&prof.on, on, __ATOMIC_RELAXED);
+}
+
+// Samples dropped since profiling was turned on, over all CPUs.
+static uint64
+proflost(void)
+{
+  uint64 n = 0;
+  int cpu;
+
+  for(cpu = 0; cpu < NCPU; cpu++)
+    n += __atomic_load_n(&prof.ring[cpu].lost, __ATOMIC_RELAXED);
+  return n;
+}
+
+// Move up to n samples to user address dst, and the number of
+// samples dropped so far to lostp, if it isn't 0. Waits while
+// there are none and profiling is on.
+// Returns the number moved, 0 once profiling is off and every
+// sample has been read, or -1 on a bad address or if killed.
+int
+profread(uint64 dst, int n, uint64 lostp)
+{
+  struct proc *p = myproc();
+  struct profring *r;
+  struct profsample s;
+  uint64 lost;
+  int i;
+
+  acquiresleep(&prof.lock);
+  i = 0;
+  for(;;){
+    for(r = prof.ring; r < &prof.ring[NCPU] && i < n; r++){
+      for(; i < n && r->tail != __atomic_load_n(&r->head, __ATOMIC_ACQUIRE); i++){
+        s = r->s[r->tail % NPROF];
+        __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+        if(copyout(p->pagetable, dst + i*sizeof(s), (char*)&s, sizeof(s)) < 0)
+          goto bad;
+      }
+    }
+    if(i > 0 || !__atomic_load_n(&prof.on, __ATOMIC_RELAXED))
+      break;
+    if(timer_sleep(timer_now() + PROF_POLL) < 0)
+      goto bad;
+  }
+  releasesleep(&prof.lock);
+  lost = proflost();
+  if(lostp != 0 && copyout(p->pagetable, lostp, (char*)&lost, sizeof(lost)) < 0)
+    return -1;
+  return i;
+
+bad:
+  releasesleep(&prof.lock);
+  return -1;
+}
@@ -0,0 +1,9 @@
+// A profiling sample, as returned by the profread() system
+// call: where a CPU was when a sampling interrupt came.
+struct profsample {
+  uint64 pc;          // the interrupted instruction
+  int pid;            // process running on the CPU, or 0
+  short cpu;
+  short user;         // 1 if pc is in the process's user code
+  char name[16];      // process name, for user samples
+};
@@ -242,6 +242,8 @@ r_stval()
 }
 
 // Machine-mode Counter-Enable
+#define MCOUNTEREN_CY (1L << 0) // lower modes may read cycle
+
 static inline void 
 w_mcounteren(uint64 x)
 {
@@ -265,6 +267,15 @@ r_time()
   return x;
 }
 
+// cycles since reset
+static inline uint64
+r_cycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, cycle" : "=r" (x) );
+  return x;
+}
+
 // enable device interrupts
 static inline void
 intr_on()
@@ -327,6 +338,14 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// stall until an interrupt is pending, even if
+// interrupts are disabled.
+static inline void
+wfi()
+{
+  asm volatile("wfi");
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
@@ -346,6 +365,8 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
 #define PTE_A (1L << 6)
+#define PTE_D (1L << 7) // written since mapped
+#define PTE_FILL (1L << 8) // Swapped out page all of one byte, see FILL2PTE
 #define PTE_PG (1L << 9)// Swapped out
 
 // shift a physical address to the right place for a PTE.
@@ -355,6 +376,10 @@ typedef uint64 *pagetable_t; // 512 PTEs
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// a PTE_FILL page keeps its byte where the PPN would be.
+#define FILL2PTE(b) ((uint64)(b) << 10)
+#define PTE2FILL(pte) (((pte) >> 10) & 0xFF)
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
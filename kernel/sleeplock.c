@@ -6,8 +6,8 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
-#include "proc.h"
 #include "sleeplock.h"
+#include "proc.h"
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -30,6 +30,35 @@ acquiresleep(struct sleeplock *lk)
   release(&lk->lk);
 }
 
+// Acquire lk if it is free, without waiting.
+// Returns 1 if it did, 0 if lk was held.
+int
+tryacquiresleep(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = !lk->locked;
+  if(r){
+    lk->locked = 1;
+    lk->pid = myproc() ? myproc()->pid : 0;
+  }
+  release(&lk->lk);
+  return r;
+}
+
+// Release lk without waking anyone, for a caller that
+// holds a p->lock, with which wakeup() can't be called.
+// Only for a lock that no process can be waiting for.
+void
+releasesleepnowake(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->locked = 0;
+  lk->pid = 0;
+  release(&lk->lk);
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
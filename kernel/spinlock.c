@@ -5,15 +5,80 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "lockstat.h"
 #include "defs.h"
 
+// Statistics are kept per lock name rather than per lock, so
+// that e.g. all "pipe" locks add up. Entries are only ever
+// added, under lockstats.lk, which is a plain test-and-set
+// lock since it can't be a spinlock itself. The counters are
+// updated with atomic adds.
+struct {
+  uint lk;
+  int n;
+  struct lockstat stat[NLOCKSTAT];
+} lockstats;
+
+// Find or make the statistics entry for name.
+// Returns 0 if the table is full.
+static struct lockstat*
+lockstatfor(char *name)
+{
+  struct lockstat *ls;
+  int i;
+
+  push_off();
+  while(__sync_lock_test_and_set(&lockstats.lk, 1) != 0)
+    ;
+  __sync_synchronize();
+  ls = 0;
+  for(i = 0; i < lockstats.n; i++){
+    if(strncmp(lockstats.stat[i].name, name, sizeof(ls->name)-1) == 0){
+      ls = &lockstats.stat[i];
+      break;
+    }
+  }
+  if(ls == 0 && lockstats.n < NLOCKSTAT){
+    ls = &lockstats.stat[lockstats.n];
+    safestrcpy(ls->name, name, sizeof(ls->name));
+    __atomic_store_n(&lockstats.n, lockstats.n + 1, __ATOMIC_RELEASE);
+  }
+  __sync_synchronize();
+  __sync_lock_release(&lockstats.lk);
+  pop_off();
+  return ls;
+}
+
+// Copy up to n entries of lock statistics to user address dst.
+// Returns the number copied, or -1 on a bad address.
+int
+lockstatcopy(uint64 dst, int n)
+{
+  struct proc *p = myproc();
+  struct lockstat ls;
+  int i;
+
+  for(i = 0; i < n && i < __atomic_load_n(&lockstats.n, __ATOMIC_ACQUIRE); i++){
+    safestrcpy(ls.name, lockstats.stat[i].name, sizeof(ls.name));
+    ls.nacquire = __atomic_load_n(&lockstats.stat[i].nacquire, __ATOMIC_RELAXED);
+    ls.ncontend = __atomic_load_n(&lockstats.stat[i].ncontend, __ATOMIC_RELAXED);
+    ls.spincycles = __atomic_load_n(&lockstats.stat[i].spincycles, __ATOMIC_RELAXED);
+    if(copyout(p->pagetable, dst + i*sizeof(ls), (char*)&ls, sizeof(ls)) < 0)
+      return -1;
+  }
+  return i;
+}
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->stat = lockstatfor(name);
 }
 
 // Acquire the lock.
@@ -21,16 +86,30 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 t0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  // Take a ticket and wait until lk->owner reaches it, so CPUs
+  // get the lock in the order they asked for it. Waiters only
+  // read lk->owner, so they don't keep stealing its cache line
+  // from each other the way a test-and-set loop does.
+  // On RISC-V, __atomic_fetch_add turns into amoadd.w.
+  ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+  if(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket){
+    t0 = r_cycle();
+    while(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
+      ;
+    if(lk->stat){
+      __atomic_fetch_add(&lk->stat->ncontend, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&lk->stat->spincycles, r_cycle() - t0, __ATOMIC_RELAXED);
+    }
+  }
+  if(lk->stat)
+    __atomic_fetch_add(&lk->stat->nacquire, 1, __ATOMIC_RELAXED);
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -59,14 +138,12 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
+  // Release the lock by serving the next ticket, equivalent
+  // to lk->owner++. Only the holder writes lk->owner, but this
+  // code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
   // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
 
   pop_off();
 }
@@ -77,7 +154,7 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->next != lk->owner && lk->cpu == mycpu());
   return r;
 }
 
@@ -1,9 +1,12 @@
 // Mutual exclusion lock.
+// A ticket lock: held unless next == owner.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Ticket for the next acquire().
+  uint owner;        // Ticket now holding the lock.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+  struct lockstat *stat; // Statistics for locks with this name.
 };
 
@@ -11,7 +11,7 @@ void timerinit();
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+uint64 timer_scratch[NCPU][4];
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
@@ -43,6 +43,10 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // let supervisor mode read the cycle counter,
+  // for spinlock statistics.
+  w_mcounteren(r_mcounteren() | MCOUNTEREN_CY);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -58,7 +62,8 @@ start()
 // they will arrive in machine mode at
 // at timervec in kernelvec.S,
 // which turns them into software interrupts for
-// devintr() in trap.c.
+// devintr() in trap.c. after the first one,
+// timer.c decides when the next should arrive.
 void
 timerinit()
 {
@@ -66,16 +71,13 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + TICK_CYCLES;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
-  // scratch[4] : desired interval (in cycles) between timer interrupts.
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
-  scratch[4] = interval;
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -3,8 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "trace.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -101,6 +103,23 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_sleepns(void);
+extern uint64 sys_uptimens(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_ioring_setup(void);
+extern uint64 sys_ioring_enter(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_pagestat(void);
+extern uint64 sys_pagectl(void);
+extern uint64 sys_tracectl(void);
+extern uint64 sys_traceread(void);
+extern uint64 sys_profctl(void);
+extern uint64 sys_profread(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -126,6 +145,23 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_sleepns] sys_sleepns,
+[SYS_uptimens] sys_uptimens,
+[SYS_lockstat] sys_lockstat,
+[SYS_ioring_setup] sys_ioring_setup,
+[SYS_ioring_enter] sys_ioring_enter,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_pagestat] sys_pagestat,
+[SYS_pagectl] sys_pagectl,
+[SYS_tracectl] sys_tracectl,
+[SYS_traceread] sys_traceread,
+[SYS_profctl] sys_profctl,
+[SYS_profread] sys_profread,
 };
 
 void
@@ -138,7 +174,9 @@ syscall(void)
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
+    trace(TR_SYSCALL, num, 0);
     p->trapframe->a0 = syscalls[num]();
+    trace(TR_SYSRET, num, p->trapframe->a0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
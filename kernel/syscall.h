@@ -20,3 +20,20 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_sleepns  22
+#define SYS_uptimens 23
+#define SYS_lockstat 24
+#define SYS_ioring_setup 25
+#define SYS_ioring_enter 26
+#define SYS_readv  27
+#define SYS_writev 28
+#define SYS_pread  29
+#define SYS_pwrite 30
+#define SYS_mmap   31
+#define SYS_munmap 32
+#define SYS_pagestat 33
+#define SYS_pagectl 34
+#define SYS_tracectl 35
+#define SYS_traceread 36
+#define SYS_profctl 37
+#define SYS_profread 38
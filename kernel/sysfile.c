@@ -10,11 +10,22 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "fs.h"
-#include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "memlayout.h"
+#include "ioring.h"
+
+// Return the open file for descriptor fd, or 0 if there is none.
+static struct file*
+fdfile(int fd)
+{
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  return myproc()->ofile[fd];
+}
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -25,7 +36,7 @@ argfd(int n, int *pfd, struct file **pf)
   struct file *f;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdfile(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -95,18 +106,88 @@ sys_write(void)
 }
 
 uint64
-sys_close(void)
+sys_readv(void)
+{
+  struct file *f;
+  int cnt;
+  uint64 iov;
+
+  argaddr(1, &iov);
+  argint(2, &cnt);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+uint64
+sys_writev(void)
 {
-  int fd;
   struct file *f;
+  int cnt;
+  uint64 iov;
 
-  if(argfd(0, &fd, &f) < 0)
+  argaddr(1, &iov);
+  argint(2, &cnt);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
+// Read or write at an explicit offset, leaving the
+// descriptor's own offset alone.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepread(f, 1, p, off, n);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, 1, p, off, n);
+}
+
+// Close descriptor fd.
+static int
+fdclose(int fd)
+{
+  struct file *f;
+
+  if((f = fdfile(fd)) == 0)
     return -1;
   myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
 
+uint64
+sys_close(void)
+{
+  int fd;
+
+  if(argfd(0, &fd, 0) < 0)
+    return -1;
+  return fdclose(fd);
+}
+
 uint64
 sys_fstat(void)
 {
@@ -222,6 +303,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcunlink(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -301,18 +383,13 @@ create(char *path, short type, short major, short minor)
   return 0;
 }
 
-uint64
-sys_open(void)
+// Open path with mode omode and return a new descriptor for it.
+static int
+doopen(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  argint(1, &omode);
-  if((n = argstr(0, path, MAXPATH)) < 0)
-    return -1;
 
   begin_op();
 
@@ -370,6 +447,18 @@ sys_open(void)
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  argint(1, &omode);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  return doopen(path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
@@ -503,3 +592,114 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// Map an I/O ring (see ioring.h) into the current process,
+// if it doesn't have one yet. Returns its address, IORING.
+uint64
+sys_ioring_setup(void)
+{
+  struct proc *p = myproc();
+
+  if(p->ioring == 0){
+    if((p->ioring = (struct ioring*)kalloc()) == 0)
+      return -1;
+    memset(p->ioring, 0, PGSIZE);
+    if(mappages(p->pagetable, IORING, PGSIZE, (uint64)p->ioring,
+                PTE_R | PTE_W | PTE_U) < 0){
+      kfree((void*)p->ioring);
+      p->ioring = 0;
+      return -1;
+    }
+  }
+  return IORING;
+}
+
+// Run one submitted operation and return its result.
+static int
+iorun(struct io_sqe *sqe)
+{
+  char path[MAXPATH];
+  struct file *f;
+
+  switch(sqe->op){
+  case IORING_OP_READ:
+    if((f = fdfile(sqe->fd)) == 0)
+      return -1;
+    return fileread(f, sqe->addr, sqe->n);
+  case IORING_OP_WRITE:
+    if((f = fdfile(sqe->fd)) == 0)
+      return -1;
+    return filewrite(f, sqe->addr, sqe->n);
+  case IORING_OP_OPEN:
+    if(copyinstr(myproc()->pagetable, path, sqe->addr, MAXPATH) < 0)
+      return -1;
+    return doopen(path, sqe->n);
+  case IORING_OP_CLOSE:
+    return fdclose(sqe->fd);
+  }
+  return -1;
+}
+
+// Run the operations queued on the current process's I/O ring,
+// in order, posting a completion for each. Stops early if the
+// completion queue fills up or the process is killed.
+// Returns the number of operations run.
+// The process is inside this system call, so it can't change
+// the ring meanwhile; still, each entry is copied before use
+// and indexes are reduced modulo the ring size.
+uint64
+sys_ioring_enter(void)
+{
+  struct proc *p = myproc();
+  struct ioring *r = p->ioring;
+  struct io_sqe sqe;
+  struct io_cqe *cqe;
+  int n;
+
+  if(r == 0 || r->sqtail - r->sqhead > IORING_ENTRIES)
+    return -1;
+
+  for(n = 0; r->sqhead != r->sqtail; n++){
+    if(r->cqtail - r->cqhead >= IORING_ENTRIES || killed(p))
+      break;
+    sqe = r->sq[r->sqhead % IORING_ENTRIES];
+    r->sqhead++;
+    cqe = &r->cq[r->cqtail % IORING_ENTRIES];
+    cqe->data = sqe.data;
+    cqe->res = iorun(&sqe);
+    r->cqtail++;
+  }
+  return n;
+}
+
+// void *mmap(void *addr, uint len, int prot, int flags, int fd, int off)
+// addr is only a hint, and is ignored.
+uint64
+sys_mmap(void)
+{
+  uint64 len;
+  int prot, flags, fd, off;
+  struct file *f;
+
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argint(4, &fd);
+  argint(5, &off);
+  f = 0;
+  if((flags & MAP_ANONYMOUS) == 0 && (f = fdfile(fd)) == 0)
+    return -1;
+  if(off < 0)
+    return -1;
+  return mmap(len, prot, flags, f, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
@@ -4,7 +4,9 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "paging.h"
 
 uint64
 sys_exit(void)
@@ -52,20 +54,25 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n < 0)
+    n = 0;
+  return timer_sleep(timer_now() + (uint64)n * TICK_CYCLES);
+}
+
+// sleep for at least n nanoseconds.
+uint64
+sys_sleepns(void)
+{
+  uint64 n, now;
+
+  argaddr(0, &n);
+  n = n / NS_PER_CYCLE + (n % NS_PER_CYCLE != 0);
+  now = timer_now();
+  if(now + n < now)
+    return timer_sleep(~0UL);
+  return timer_sleep(now + n);
 }
 
 uint64
@@ -77,15 +84,129 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
+// return how many clock ticks have passed
 // since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return timer_now() / TICK_CYCLES;
+}
+
+// copy statistics for up to n lock names to
+// the user array of struct lockstat at addr.
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return lockstatcopy(addr, n);
+}
+
+// return how many nanoseconds have passed
+// since start.
+uint64
+sys_uptimens(void)
+{
+  return timer_now() * NS_PER_CYCLE;
+}
+
+// copy the paging statistics of process pid, or of the
+// caller if pid is 0, or of the whole system if pid is -1,
+// to the struct pagestat at user address addr.
+uint64
+sys_pagestat(void)
+{
+  int pid;
+  uint64 addr;
+  struct pagestat st;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  if(pagestats(pid, &st) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// change one of the calling process's paging attributes,
+// see PAGECTL_* in paging.h. returns the old value.
+uint64
+sys_pagectl(void)
+{
+  int op, arg, old;
+  struct proc *p = myproc();
+
+  argint(0, &op);
+  argint(1, &arg);
+  switch(op){
+  case PAGECTL_PIN:
+    old = p->pinexec;
+    p->pinexec = arg != 0;
+    return old;
+#if SWAP_ALGO != NONE
+  case PAGECTL_LIMIT:
+    return setpglimit(p, arg);
+  case PAGECTL_POLICY:
+    return setpgpolicy(p, arg);
+  case PAGECTL_SYSPOLICY:
+    return setsyspolicy(arg);
+  case PAGECTL_ZSWAP:
+    return zswapctl(arg);
+#endif
+  }
+  return -1;
+}
+
+// turn kernel event tracing on or off.
+// returns the old setting.
+uint64
+sys_tracectl(void)
+{
+  int on;
+
+  argint(0, &on);
+  return tracectl(on);
+}
+
+// move up to n kernel trace events to the user
+// array of struct tracerec at addr.
+uint64
+sys_traceread(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return traceread(addr, n);
+}
+
+// turn the sampling profiler on or off.
+// returns the old setting.
+uint64
+sys_profctl(void)
+{
+  int on;
+
+  argint(0, &on);
+  return profctl(on);
+}
+
+// move up to n profiling samples to the user array of
+// struct profsample at addr, and the number of samples
+// dropped to the uint64 at lost, if it isn't 0.
+uint64
+sys_profread(void)
+{
+  uint64 addr, lost;
+  int n;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  argaddr(0, &addr);
+  argint(1, &n);
+  argaddr(2, &lost);
+  return profread(addr, n, lost);
 }
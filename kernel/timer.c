@@ -0,0 +1,260 @@
+// Timers.
+//
+// Each CPU keeps a queue of pending timers, earliest first,
+// and programs its CLINT mtimecmp register for the next moment
+// it needs an interrupt: the earliest timer, or the end of the
+// running process's time slice. An idle CPU has no time slice,
+// so it is only woken by its own timers, device interrupts,
+// or an occasional idle check for work to steal.
+//
+// timervec in kernelvec.S disarms mtimecmp and forwards each
+// machine-mode timer interrupt to devintr() as a supervisor
+// software interrupt, which calls timerintr().
+//
+// Times are in CLINT mtime cycles since boot (MTIME_HZ per second).
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+// how often an idle CPU wakes up to look for work to steal.
+#define IDLE_CYCLES TICK_CYCLES
+
+struct timerq {
+  struct spinlock lock;
+  struct timer *head;   // pending timers, earliest first
+  uint64 slice;         // end of current time slice; 0 if idle
+  uint64 armed;         // deadline programmed into mtimecmp
+} timerq[NCPU];
+
+uint64 sampling;        // longest gap between interrupts, or 0
+
+void
+timerqinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&timerq[i].lock, "timerq");
+}
+
+// current time in mtime cycles.
+uint64
+timer_now(void)
+{
+  return *(volatile uint64*)CLINT_MTIME;
+}
+
+// Program this CPU's mtimecmp for the next event.
+// Caller must hold q->lock, where q is this CPU's queue.
+static void
+tqarm(struct timerq *q, int id)
+{
+  uint64 when, period;
+
+  when = q->slice;
+  if(when == 0)
+    when = timer_now() + IDLE_CYCLES;
+  if(q->head && q->head->when < when)
+    when = q->head->when;
+  period = __atomic_load_n(&sampling, __ATOMIC_RELAXED);
+  if(period && when > timer_now() + period)
+    when = timer_now() + period;
+  q->armed = when;
+  *(volatile uint64*)CLINT_MTIMECMP(id) = when;
+}
+
+// Lock and return this CPU's timer queue.
+static struct timerq*
+tqlock(int *id)
+{
+  struct timerq *q;
+
+  push_off();
+  *id = cpuid();
+  q = &timerq[*id];
+  acquire(&q->lock);
+  pop_off();
+  return q;
+}
+
+// Insert t into q, which belongs to CPU id.
+// Caller must hold q->lock.
+static void
+tqinsert(struct timerq *q, int id, struct timer *t)
+{
+  struct timer **tp;
+
+  for(tp = &q->head; *tp && (*tp)->when <= t->when; tp = &(*tp)->next)
+    ;
+  t->next = *tp;
+  *tp = t;
+  t->cpu = id;
+  if(q->armed == 0 || t->when < q->armed)
+    tqarm(q, id);
+}
+
+// Remove t from q if it is still queued there.
+// Caller must hold q->lock.
+static void
+tqremove(struct timerq *q, struct timer *t)
+{
+  struct timer **tp;
+
+  for(tp = &q->head; *tp; tp = &(*tp)->next){
+    if(*tp == t){
+      *tp = t->next;
+      break;
+    }
+  }
+  t->cpu = -1;
+}
+
+// Arrange for t->fn(t) to be called at time when, on this CPU.
+// fn runs in interrupt context with the timer queue locked, so
+// it must be brief and must not add or cancel timers.
+// t must not already be pending.
+void
+timer_add(struct timer *t, uint64 when)
+{
+  struct timerq *q;
+  int id;
+
+  q = tqlock(&id);
+  t->when = when;
+  tqinsert(q, id, t);
+  release(&q->lock);
+}
+
+// Make sure t won't fire. Does nothing if it already has.
+void
+timer_cancel(struct timer *t)
+{
+  struct timerq *q;
+  int id;
+
+  if((id = t->cpu) < 0)
+    return;
+  q = &timerq[id];
+  acquire(&q->lock);
+  if(t->cpu == id)
+    tqremove(q, t);
+  release(&q->lock);
+}
+
+static void
+timer_wake(struct timer *t)
+{
+  wakeup(t);
+}
+
+// Sleep until time when.
+// Returns -1 if the process is killed first, 0 otherwise.
+int
+timer_sleep(uint64 when)
+{
+  struct timer t;
+  struct timerq *q;
+  struct proc *p = myproc();
+  int id, r;
+
+  t.fn = timer_wake;
+  t.when = when;
+  q = tqlock(&id);
+  tqinsert(q, id, &t);
+  r = 0;
+  while(t.cpu >= 0){
+    if(killed(p)){
+      tqremove(q, &t);
+      r = -1;
+      break;
+    }
+    sleep(&t, &q->lock);
+  }
+  release(&q->lock);
+  return r;
+}
+
+// The end of the time slice that includes time now. Slices
+// end on tick boundaries, so that processes see ticks change
+// (see struct usyscall) when their slice ends.
+static uint64
+sliceend(uint64 now)
+{
+  return (now / TICK_CYCLES + 1) * TICK_CYCLES;
+}
+
+// Start a time slice on this CPU, for the process the
+// scheduler is about to run.
+void
+timer_slice(void)
+{
+  struct timerq *q;
+  int id;
+
+  q = tqlock(&id);
+  q->slice = sliceend(timer_now());
+  tqarm(q, id);
+  release(&q->lock);
+}
+
+// Interrupt every CPU at least every period cycles, for the
+// profiler, or stop if period is 0. Other CPUs pick up the
+// change the next time they program mtimecmp, within a tick.
+void
+timer_sampling(uint64 period)
+{
+  struct timerq *q;
+  int id;
+
+  __atomic_store_n(&sampling, period, __ATOMIC_RELAXED);
+  q = tqlock(&id);
+  tqarm(q, id);
+  release(&q->lock);
+}
+
+// This CPU has nothing to run: stop the time slice, so that
+// only timers and the idle check wake it up.
+void
+timer_idle(void)
+{
+  struct timerq *q;
+  int id;
+
+  q = tqlock(&id);
+  q->slice = 0;
+  tqarm(q, id);
+  release(&q->lock);
+}
+
+// Handle a timer interrupt on this CPU: run expired timers
+// and program the next interrupt.
+// Returns 1 if the current time slice is over, 0 if not.
+int
+timerintr(void)
+{
+  struct timerq *q;
+  struct timer *t;
+  uint64 now;
+  int id, expired;
+
+  q = tqlock(&id);
+  now = timer_now();
+  while((t = q->head) != 0 && t->when <= now){
+    q->head = t->next;
+    t->cpu = -1;
+    t->fn(t);
+  }
+  expired = q->slice != 0 && q->slice <= now;
+  if(expired)
+    q->slice = sliceend(now);
+  tqarm(q, id);
+  release(&q->lock);
+  return expired;
+}
@@ -0,0 +1,8 @@
+// A timer on one CPU's queue, see timer.c.
+struct timer {
+  uint64 when;                // mtime at which to call fn
+  void (*fn)(struct timer*);  // called from the timer interrupt
+  void *arg;                  // for fn's use
+  struct timer *next;         // next timer on the same queue
+  int cpu;                    // queue t is on, or -1 if none
+};
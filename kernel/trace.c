@@ -0,0 +1,140 @@
+// Kernel event trace.
+//
+// trace() appends an event to a ring of the CPU it runs on,
+// with interrupts off, so each ring has a single writer and
+// needs no lock. traceread() drains the rings in time order,
+// holding tracebuf.lock so that each ring also has a single
+// reader. head and tail only grow: the writer publishes an
+// event by advancing head with a release store, and the
+// reader gives its slot back by advancing tail. A full ring drops new
+// events and counts them, and the reader hands the count on
+// as a TR_LOST event.
+//
+// Tracing is off until tracectl() turns it on, and until then
+// trace() is a load and a branch.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "trace.h"
+#include "defs.h"
+
+struct tracering {
+  uint head;                    // next slot to write
+  uint tail;                    // next slot to read
+  uint lost;                    // events dropped since the last read
+  struct tracerec rec[NTRACE];
+};
+
+struct {
+  struct sleeplock lock;        // one reader at a time
+  int on;
+  struct tracering ring[NCPU];
+} tracebuf;
+
+void
+traceinit(void)
+{
+  initsleeplock(&tracebuf.lock, "trace");
+}
+
+// Record an event of type on this CPU, if tracing is on.
+void
+trace(int type, uint64 a0, uint64 a1)
+{
+  struct tracering *r;
+  struct tracerec *e;
+  struct proc *p;
+  uint head;
+
+  if(!__atomic_load_n(&tracebuf.on, __ATOMIC_RELAXED))
+    return;
+  push_off();
+  r = &tracebuf.ring[cpuid()];
+  head = r->head;
+  if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == NTRACE){
+    __atomic_fetch_add(&r->lost, 1, __ATOMIC_RELAXED);
+  } else {
+    e = &r->rec[head % NTRACE];
+    e->time = timer_now();
+    e->type = type;
+    e->cpu = cpuid();
+    p = mycpu()->proc;
+    e->pid = p ? p->pid : 0;
+    e->a0 = a0;
+    e->a1 = a1;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+  }
+  pop_off();
+}
+
+// Turn tracing on or off. Returns the old setting.
+int
+tracectl(int on)
+{
+  return __atomic_exchange_n(&tracebuf.on, on != 0, __ATOMIC_RELAXED);
+}
+
+// The oldest event in ring r, or 0 if r is empty.
+static struct tracerec*
+oldest(struct tracering *r)
+{
+  if(r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+    return 0;
+  return &r->rec[r->tail % NTRACE];
+}
+
+// Move up to n trace events to user address dst, merging the
+// rings so that the events come out in time order.
+// Returns the number moved, or -1 on a bad address.
+int
+traceread(uint64 dst, int n)
+{
+  struct proc *p = myproc();
+  struct tracering *r, *min;
+  struct tracerec e, *ep, *minp;
+  uint lost;
+  int i, cpu;
+
+  acquiresleep(&tracebuf.lock);
+  i = 0;
+  for(cpu = 0; cpu < NCPU && i < n; cpu++){
+    r = &tracebuf.ring[cpu];
+    if((lost = __atomic_exchange_n(&r->lost, 0, __ATOMIC_RELAXED)) == 0)
+      continue;
+    memset(&e, 0, sizeof(e));
+    e.time = timer_now();
+    e.type = TR_LOST;
+    e.cpu = cpu;
+    e.a0 = lost;
+    if(copyout(p->pagetable, dst + i*sizeof(e), (char*)&e, sizeof(e)) < 0)
+      goto bad;
+    i++;
+  }
+  for(; i < n; i++){
+    min = 0;
+    minp = 0;
+    for(r = tracebuf.ring; r < &tracebuf.ring[NCPU]; r++){
+      if((ep = oldest(r)) != 0 && (minp == 0 || ep->time < minp->time)){
+        min = r;
+        minp = ep;
+      }
+    }
+    if(min == 0)
+      break;
+    e = *minp;
+    __atomic_store_n(&min->tail, min->tail + 1, __ATOMIC_RELEASE);
+    if(copyout(p->pagetable, dst + i*sizeof(e), (char*)&e, sizeof(e)) < 0)
+      goto bad;
+  }
+  releasesleep(&tracebuf.lock);
+  return i;
+
+bad:
+  releasesleep(&tracebuf.lock);
+  return -1;
+}
@@ -0,0 +1,23 @@
+// A kernel trace event, as returned by the traceread() system
+// call. Each CPU records its own events, in time order.
+struct tracerec {
+  uint64 time;        // timer_now() when it happened
+  ushort type;        // TR_*
+  ushort cpu;         // CPU it happened on
+  int pid;            // process running on that CPU, or 0
+  uint64 a0, a1;      // details, by type
+};
+
+#define TR_LOST        1   // a0: events cpu dropped, its buffer full
+#define TR_RUN         2   // the scheduler switched to pid
+#define TR_STOP        3   // pid gave the CPU back; a0: its state
+#define TR_SYSCALL     4   // a0: system call number
+#define TR_SYSRET      5   // a0: system call number, a1: return value
+#define TR_FAULT       6   // a0: va
+#define TR_FAULTDONE   7   // a0: va, a1: 0 if it was not handled
+#define TR_SWAPOUT     8   // a0: va of the page evicted
+#define TR_DISK        9   // a0: block, a1: 1 for a write; submitted
+#define TR_DISKDONE    10  // a0: block; the disk finished with it
+#define TR_BEGINOP     11  // a0: outstanding ops, a1: times it waited
+#define TR_COMMIT      12  // a0: blocks in the transaction
+#define TR_COMMITDONE  13
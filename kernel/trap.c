@@ -3,11 +3,11 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
-
-struct spinlock tickslock;
-uint ticks;
+#include "paging.h"
+#include "trace.h"
 
 extern char trampoline[], uservec[], userret[];
 
@@ -19,7 +19,7 @@ extern int devintr();
 void
 trapinit(void)
 {
-  initlock(&tickslock, "time");
+  timerqinit();
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -159,19 +159,23 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
-void
-clockintr()
+// count a page fault of p's that took cycles to service,
+// in the histogram described in paging.h.
+static void
+faultlat(struct proc *p, uint64 cycles)
 {
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
+  int k;
+
+  for(k = 0; k < NFAULTLAT-1 && cycles >= ((uint64)FAULTLAT_MIN << k); k++)
+    ;
+  PGCOUNT(p, faultlat[k]);
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
-// 1 if other device,
+// returns 2 if timer interrupt ending the time slice,
+// 1 if other device or timer interrupt,
+// 3 if a page fault that has been handled,
 // 0 if not recognized.
 int
 devintr()
@@ -204,22 +208,45 @@ devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // sepc is still where the interrupt came from.
+    profintr(r_sepc(), (r_sstatus() & SSTATUS_SPP) == 0);
+
+    int expired = timerintr();
+
+    // time slices end on tick boundaries, so this keeps
+    // the running process's view of ticks current.
+    if(myproc() != 0)
+      myproc()->usyscall->ticks = timer_now() / TICK_CYCLES;
+
+    // only ask the caller to yield once the
+    // time slice is used up.
+    return expired ? 2 : 1;
   
   } 
-  #if SWAP_ALGO != NONE
-  else if (scause == 13 || scause == 15) {
-    return page_fault(myproc(), PGROUNDDOWN(r_stval()));
+  else if ((scause == 13 || scause == 15) && myproc() != 0) {
+    // load or store page fault: an mmap() page not yet
+    // mapped, or a page in the swap file.
+    struct proc *p = myproc();
+    uint64 va = PGROUNDDOWN(r_stval());
+    uint64 start = r_cycle();
+    int handled = 0;
+    PGCOUNT(p, faults);
+    trace(TR_FAULT, va, 0);
+    if (vmafault(p, va, scause == 15) == 0)
+      handled = 3;
+    #if SWAP_ALGO != NONE
+    else
+      handled = page_fault(p, va);
+    #endif
+    if (handled)
+      faultlat(p, r_cycle() - start);
+    trace(TR_FAULTDONE, va, handled != 0);
+    return handled;
   }
-  #endif
   else {
     return 0;
   }
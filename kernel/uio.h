@@ -0,0 +1,7 @@
+// One buffer of a readv() or writev() request.
+struct iovec {
+  void *iov_base;     // start of buffer
+  int iov_len;        // length in bytes
+};
+
+#define IOV_MAX 16    // most buffers per readv() or writev()
@@ -10,6 +10,7 @@
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
+#include "trace.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -178,7 +179,6 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
@@ -194,6 +194,9 @@ free_chain(int i)
     else
       break;
   }
+  // a chain has as many descriptors as one
+  // waiter in alloc3_desc() needs.
+  wakeone(&disk.free[0]);
 }
 
 // allocate three descriptors (they need not be contiguous).
@@ -279,6 +282,7 @@ virtio_disk_rw(struct buf *b, int write)
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  trace(TR_DISK, b->blockno, write);
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
@@ -318,6 +322,7 @@ virtio_disk_intr()
 
     struct buf *b = disk.info[id].b;
     b->disk = 0;   // disk is done with buf
+    trace(TR_DISKDONE, b->blockno, 0);
     wakeup(b);
 
     disk.used_idx += 1;
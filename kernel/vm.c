@@ -7,7 +7,9 @@
 #include "defs.h"
 #include "fs.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "trace.h"
 
 /*
  * the kernel's page table.
@@ -30,6 +32,9 @@ kvmmake(void)
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, so timer.c can read mtime and set mtimecmp
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
@@ -105,8 +110,38 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   return &pagetable[PX(0, va)];
 }
 
+// Fault in page va of the current process for the kernel,
+// as a user access would, a write if write is set: an mmap()
+// page not touched yet or dropped by vmaevict(), or a page in
+// the swap file.
+// Faulting may sleep, so it is only done with interrupts on,
+// which means that no spinlock is held. Nor is it done while
+// p has a log operation open or an inode locked: the eviction
+// it may cause writes to a file or the swap file, which needs
+// a log operation and inode locks of its own, and may wait
+// for the laundry's writes, which need log space. The file
+// layer copies such pages through a kernel page instead (see
+// readbounce() in file.c).
+// Returns 1 if va is now mapped.
+static int
+faultin(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || pagetable != p->pagetable || !intr_get() || p->fsops)
+    return 0;
+  if(vmafault(p, va, write) == 0)
+    return 1;
+#if SWAP_ALGO != NONE
+  return page_fault(p, va) != 0;
+#else
+  return 0;
+#endif
+}
+
 // Look up a virtual address, return the physical address,
-// or 0 if not mapped.
+// or 0 if not mapped. A page of the current process that
+// isn't in memory yet is faulted in.
 // Can only be used to look up user pages.
 uint64
 walkaddr(pagetable_t pagetable, uint64 va)
@@ -118,6 +153,8 @@ walkaddr(pagetable_t pagetable, uint64 va)
     return 0;
 
   pte = walk(pagetable, va, 0);
+  if((pte == 0 || (*pte & PTE_V) == 0) && faultin(pagetable, va, 0))
+    pte = walk(pagetable, va, 0);
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
@@ -170,26 +207,6 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 
 #if SWAP_ALGO != NONE
 
- void remove_scfifo(struct proc *p, int position) {
-
-    struct scfifo *scfifo = &p->scfifo[position];
-    if (scfifo == p->newest && scfifo == p->oldest) {
-      p->oldest = 0;
-      p->newest = 0;
-    } else if (scfifo == p->oldest) {
-      p->oldest = p->oldest->newer;
-      p->oldest->older = 0;
-    } else if (scfifo == p->newest) {
-      p->newest = p->newest->older;
-      p->newest->newer = 0;
-    } else {
-      scfifo->older->newer = scfifo->newer;
-      scfifo->newer->older = scfifo->older;
-    }
-    scfifo->newer = 0;
-    scfifo->older = 0;
-  }
-
   int freePage(struct page *pages, uint64 va) {
     struct page *page;
     int i = 0;
@@ -205,6 +222,24 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
     panic("couldn't find page");
     return -1;
   }
+
+  // Stop tracking page va of p, which is in memory if
+  // resident, or else in the swap file.
+  // Caller must hold p->pglock.
+  void forget_page(struct proc *p, uint64 va, int resident) {
+    if (resident) {
+      int position = freePage(p->memory_pages, va);
+      pgremove(p, &p->memory_pages[position]);
+      p->num_of_phys_pages--;
+    } else {
+      struct page *page = &p->swapfile_pages[freePage(p->swapfile_pages, va)];
+      laundry_cancel(p, page);
+      if (page->zhandle) {
+        zswap_free(page->zhandle);
+        page->zhandle = 0;
+      }
+    }
+  }
 #endif
 
 // Remove npages of mappings starting from va. va must be
@@ -217,12 +252,16 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   pte_t *pte;
   #if SWAP_ALGO != NONE
     struct proc *p = myproc();
-    int sh_init = sh_or_init(p);
+    int paged = !p->pinned && pagetable == p->pagetable;
   #endif
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
+  #if SWAP_ALGO != NONE
+    if (paged)
+      acquiresleep(&p->pglock);
+  #endif
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
       panic("uvmunmap: walk");
@@ -232,26 +271,22 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
       panic("uvmunmap: not a leaf");
     if(do_free && (*pte & PTE_V)){
       #if SWAP_ALGO != NONE
-        if (sh_init && pagetable == p->pagetable) {
-          #if SWAP_ALGO == SCFIFO
-            int position = freePage(p->memory_pages, a);
-            remove_scfifo(p, position);
-          #else
-            freePage(p->memory_pages, a);
-          #endif
-          p->num_of_phys_pages--;
-        }
+        if (paged)
+          forget_page(p, a, 1);
       #endif
       uint64 pa = PTE2PA(*pte);
       kfree((void*)pa);
     }
     #if SWAP_ALGO != NONE
-      if (sh_init && pagetable == p->pagetable && (*pte & PTE_PG)) {
-        freePage(p->swapfile_pages, a);
-      }
+      if (paged && (*pte & (PTE_PG | PTE_FILL)) == PTE_PG)
+        forget_page(p, a, 0);
     #endif
     *pte = 0;
   }
+  #if SWAP_ALGO != NONE
+    if (paged)
+      releasesleep(&p->pglock);
+  #endif
 }
 
 // create an empty user page table.
@@ -291,8 +326,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
   char *mem;
   uint64 a;
   #if SWAP_ALGO != NONE
-    int sh_init = sh_or_init(myproc()); 
-    if (sh_init && newsz >= MAX_TOTAL_PAGES * PGSIZE)
+    // exec() builds the new image in another page table, and
+    // only tracks its pages once it commits to it.
+    struct proc *p = myproc();
+    int paged = !p->pinned && pagetable == p->pagetable;
+    if (paged && newsz >= pagebudget(p))
       return 0;
   #endif
   if(newsz < oldsz)
@@ -311,8 +349,10 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
       return 0;
     }
     #if SWAP_ALGO != NONE
-      if (sh_init) {
-        allocate_page(pagetable, a); 
+      if (paged) {
+        acquiresleep(&p->pglock);
+        allocate_page(pagetable, a);
+        releasesleep(&p->pglock);
       }
     #endif
   }
@@ -397,9 +437,12 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
         goto err;
       }
     } else {
+      // swapped out: the child's swap file is a copy, and a
+      // PTE_FILL page is all in the PTE.
       pte_t *npte;
-      npte = walk(new, i, 0);
-      *npte |= PTE_FLAGS(*pte);
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      *npte = *pte;
     }
   }
   return 0;
@@ -424,17 +467,26 @@ uvmclear(pagetable_t pagetable, uint64 va)
 
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
+// The pages must be writable by the user, and are marked accessed
+// and dirty, as a user store would mark them.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if(va0 >= MAXVA)
+      return -1;
+    pte = walk(pagetable, va0, 0);
+    if((pte == 0 || (*pte & PTE_V) == 0) && faultin(pagetable, va0, 1))
+      pte = walk(pagetable, va0, 0);
+    if(pte == 0 || (*pte & (PTE_V|PTE_U|PTE_W)) != (PTE_V|PTE_U|PTE_W))
       return -1;
+    *pte |= PTE_A | PTE_D;
+    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -515,74 +567,6 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   }
 }
 #if SWAP_ALGO != NONE
-  void set_scfifo(struct proc *p, int position) {
-    struct scfifo *scfifo = &p->scfifo[position];
-    scfifo->position = position;
-    scfifo->newer = 0;
-    scfifo->older = p->newest;
-    if (p->newest != 0)
-      p->newest->newer = scfifo;
-    p->newest = scfifo;
-    if (p->oldest == 0) {
-      p->oldest = scfifo;
-      scfifo->older = 0;
-    } 
-  }
-
-  #if SWAP_ALGO == LAPA
-  uint ones(uint64 counter) {
-    uint counter_ones = 0;
-    while (counter != 0) {
-      counter_ones += counter & 1;
-      counter >>= 1;
-    }
-    return counter_ones;
-  }
-  #endif
-
-  struct page* findPageToEvict(struct page *pages) {
-    struct page *min_page = 0;
-    #if SWAP_ALGO == SCFIFO
-      pte_t *pte;
-      struct proc *p = myproc();
-      while (min_page == 0) {
-        int position = p->oldest->position;
-        min_page = &pages[position];
-        pte = walk(p->pagetable, min_page->va, 0);
-        if ((*pte & PTE_A) == 0) 
-          return min_page;
-        *pte &= ~PTE_A;
-        remove_scfifo(p, position);
-        set_scfifo(p, position);
-        min_page = 0;
-      }
-      return 0;
-    #else
-      struct page *page;
-      uint min_ones = 100;
-      for (page = pages; page < &pages[MAX_PSYC_PAGES]; page++) {
-        if (page->status == INMEMORY) {
-          #if SWAP_ALGO == NFUA
-            if (min_page == 0 || page->counter < min_page->counter) {
-              min_page = page;
-            }
-          #endif
-          #if SWAP_ALGO == LAPA
-            uint page_ones;
-            page_ones = ones(page->counter);
-            if (page_ones < min_ones || (page_ones == min_ones && page->counter < min_page->counter)) {
-              min_page = page;
-              min_ones = page_ones;
-            }
-          #endif
-        }
-      }
-      if (min_page == 0)
-        panic("no min page");
-      return min_page;
-    #endif
-  }
-
   int findFree(struct page *pages) {
     for (int i = 0; i < MAX_PSYC_PAGES; i++) {
       if (pages[i].status == UNUSED)
@@ -603,98 +587,176 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
     return -1;
   }
 
+  // If the page at pa is all one byte, return it, else -1.
+  int samefill(uint64 *pa) {
+    uint64 w = pa[0];
+    if (w != (w & 0xFF) * 0x0101010101010101)
+      return -1;
+    for (int i = 1; i < PGSIZE / sizeof(uint64); i++) {
+      if (pa[i] != w)
+        return -1;
+    }
+    return w & 0xFF;
+  }
+
+  // Evict one of the current process's pages.
+  // Caller must hold its pglock.
   void swap_out(pagetable_t pagetable) {
     struct proc *p = myproc();
     pte_t *pte;
-    uint64 pa;
+    uint64 pa, va;
     struct page *swapfile_page;
     struct page *memory_page;
-    int position;
-    position = findFree(p->swapfile_pages);
-    swapfile_page = &p->swapfile_pages[position];
-    memory_page = findPageToEvict(p->memory_pages);
-    swapfile_page->va = memory_page->va;
-    swapfile_page->status = PAGED;
-    memory_page->va = 0;
-    memory_page->status = UNUSED;
-    p->num_of_phys_pages--;
-    pte = walk(pagetable, swapfile_page->va, 0);
+    int position, fill;
+    memory_page = pgvictim(p);
+    va = memory_page->va;
+    trace(TR_SWAPOUT, va, 0);
+    forget_page(p, va, 1);
+    pte = walk(pagetable, va, 0);
     pa = PTE2PA(*pte);
-    writeToSwapFile(p, (char*)pa, position * PGSIZE, PGSIZE);
-    *pte &= ~PTE_V;
-    *pte |= PTE_PG;
+    // pages of mapped files go back to the file instead.
+    if (vmaevict(p, va, pte) == 0) {
+      if ((fill = samefill((uint64*)pa)) >= 0) {
+        // all one byte: keep just that, in the PTE.
+        *pte = (PTE_FLAGS(*pte) & ~PTE_V) | PTE_PG | PTE_FILL | FILL2PTE(fill);
+        PGCOUNT(p, fillouts);
+      } else {
+        position = findFree(p->swapfile_pages);
+        swapfile_page = &p->swapfile_pages[position];
+        swapfile_page->va = va;
+        swapfile_page->status = PAGED;
+        *pte &= ~PTE_V;
+        *pte |= PTE_PG;
+        // compressed into memory if it can be, else to disk,
+        // by the laundry, which frees the frame after.
+        if ((swapfile_page->zhandle = zswap_store((char*)pa)) != 0) {
+          PGCOUNT(p, zswapouts);
+        } else {
+          laundry_add(p, position, (char*)pa);
+          PGCOUNT(p, swapouts);
+          return;
+        }
+      }
+    }
     kfree((void *)pa);
   }
 
-  void set_counter(struct page *page) {
-    #if SWAP_ALGO == NFUA
-      page->counter = 0;
-    #elif SWAP_ALGO == LAPA
-      page->counter = 0xFFFFFFFFFFFFFFFF;
-    #endif
-  }
-
+  // Track page va, just mapped, as one of the current
+  // process's pages in memory, evicting another if it is at
+  // its limit. Caller must hold its pglock.
   void allocate_page(pagetable_t pagetable, uint64 va) {
     struct proc *p = myproc();
     struct page *page;
     int position;
-    
-    if (p->num_of_phys_pages == MAX_PSYC_PAGES)
+
+    if (!holdingsleep(&p->pglock))
+      panic("allocate_page: pglock");
+    pgsync(p);
+    if (p->num_of_phys_pages >= p->pglimit)
       swap_out(pagetable);
     position = findFree(p->memory_pages);
     page = &p->memory_pages[position];
     page->status = INMEMORY;
     page->va = va;
-    #if SWAP_ALGO == SCFIFO
-      set_scfifo(p, position);
-    #else
-      set_counter(page);
-    #endif
+    pginsert(p, page);
     p->num_of_phys_pages++;
   }
 
+  // Bring page va of p back into memory.
+  // Returns 3 if it did, 0 if va isn't a swapped-out page
+  // or there is no memory to bring it back into.
   int page_fault(struct proc *p, uint64 va) {
     pte_t *pte;
     char *mem;
     int position;
+    struct page *swapfile_page;
+    if (va >= MAXVA)
+      return 0;             // Seg fault
+    // p->pglock keeps the page where it is until it is back,
+    // while faults of other processes go on.
+    acquiresleep(&p->pglock);
     pte = walk(p->pagetable, va, 0);
-    if ((*pte & PTE_PG) == 0) {
+    if (pte == 0 || (*pte & PTE_PG) == 0) {
+      releasesleep(&p->pglock);
       return 0;             // Seg fault
     }
-    mem = kalloc();
+    if (*pte & PTE_FILL) {
+      if ((mem = kalloc()) == 0) {
+        releasesleep(&p->pglock);
+        return 0;           // out of memory
+      }
+      memset(mem, PTE2FILL(*pte), PGSIZE);
+      PGCOUNT(p, fillins);
+      allocate_page(p->pagetable, va);
+      *pte = PA2PTE((uint64)mem) | (PTE_FLAGS(*pte) & ~(PTE_PG | PTE_FILL)) | PTE_V;
+      releasesleep(&p->pglock);
+      return 3;
+    }
     position = findPageLocation(p->swapfile_pages, va);
-    readFromSwapFile(p, mem, position * PGSIZE, PGSIZE);
+    swapfile_page = &p->swapfile_pages[position];
+    if ((mem = laundry_rescue(p, swapfile_page)) != 0) {
+      // not written out yet: the frame still has it.
+      PGCOUNT(p, rescues);
+    } else if ((mem = kalloc()) == 0) {
+      // out of memory: the page stays where it is.
+      swapfile_page->status = PAGED;
+      releasesleep(&p->pglock);
+      return 0;
+    } else if (swapfile_page->zhandle) {
+      zswap_load(swapfile_page->zhandle, mem);
+      zswap_free(swapfile_page->zhandle);
+      swapfile_page->zhandle = 0;
+      PGCOUNT(p, zswapins);
+    } else {
+      readFromSwapFile(p, mem, position * PGSIZE, PGSIZE);
+      PGCOUNT(p, swapins);
+    }
     allocate_page(p->pagetable, va);
     *pte = PA2PTE((uint64)mem) | PTE_FLAGS(*pte);
     *pte &= ~PTE_PG;
     *pte |= PTE_V;
+    releasesleep(&p->pglock);
     return 3;
   }
 
-  void update_counters(struct proc *p) {
-    struct page *page;
+  // Track the pages of p's image, as exec() has just
+  // committed to it, swapping out those that don't fit.
+  void trackpages(struct proc *p) {
     pte_t *pte;
-    for (page = p->memory_pages; page < &p->memory_pages[MAX_PSYC_PAGES]; page++) {
-      if (page->status == INMEMORY) {
-        pte = walk(p->pagetable, page->va, 0);
-        page->counter = page->counter >> 1;
-        if (*pte & PTE_A) {
-          page->counter |= 0x8000000000000000;
-          *pte &= ~PTE_A;
-        }
-      }
+    acquiresleep(&p->pglock);
+    for (uint64 a = 0; a < p->sz; a += PGSIZE) {
+      if ((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_V))
+        allocate_page(p->pagetable, a);
     }
+    releasesleep(&p->pglock);
   }
 
-int sh_or_init(struct proc *p) {
-  int size = sizeof(p->name);
-  if (strncmp(p->name, "sh", size) == 0)
-    return 0;
-  if (strncmp(p->name, "init", size) == 0)
-    return 0;
-  if (strncmp(p->name, "initcode", size) == 0)
-    return 0;
-  return 1;
-}
+  // The most user memory paged process p may have: its
+  // resident limit plus the swap file.
+  uint64 pagebudget(struct proc *p) {
+    return (uint64)(p->pglimit + MAX_PAGED_PAGES) * PGSIZE;
+  }
+
+  // Change p's resident limit to limit pages, swapping
+  // pages out until p is within it.
+  // Returns the old limit, or -1 if p is too big.
+  int setpglimit(struct proc *p, int limit) {
+    int old;
+    if (limit < 1 || limit > MAX_PSYC_PAGES)
+      return -1;
+    if (!p->pinned &&
+        PGROUNDUP(p->sz) + vmaprivate(p) > (uint64)(limit + MAX_PAGED_PAGES) * PGSIZE)
+      return -1;
+    old = p->pglimit;
+    p->pglimit = limit;
+    if (!p->pinned) {
+      acquiresleep(&p->pglock);
+      pgsync(p);
+      while (p->num_of_phys_pages > limit)
+        swap_out(p->pagetable);
+      releasesleep(&p->pglock);
+    }
+    return old;
+  }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,279 @@
+// Compressed swap pool.
+//
+// swap_out() first tries to compress an evicted page into a
+// pool of kernel memory, and only writes it to the swap file
+// if it doesn't compress well enough or the pool is full.
+// page_fault() then gets it back with a decompression instead
+// of a disk read. The page keeps its swap file slot either
+// way, so a process never has more pages out than it has
+// slots for.
+//
+// The pool is up to NZSWAP pages, taken from kalloc() as they
+// are needed and given back when they empty. Each pool page
+// is split into 64 chunks of 64 bytes, with a bitmap of those
+// in use, and a compressed page is a run of chunks within one
+// pool page. A page in the pool is named by a handle, an index
+// into zswap.ent plus one, so that 0 means none. Entries are
+// reference counted, for fork().
+//
+// The compressor is a small LZ77: a byte c < 0x80 is followed
+// by c+1 literal bytes, and a byte c >= 0x80 is a copy of
+// (c & 0x7f) + 3 bytes from a 16-bit offset back.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+
+#if SWAP_ALGO != NONE
+
+#define CHUNK     64
+#define NCHUNK    (PGSIZE / CHUNK)
+#define MAXLEN    (PGSIZE * 3 / 4)   // pages that compress worse go to disk
+#define NZENT     (NZSWAP * 8)
+#define MINMATCH  3
+#define MAXMATCH  (0x7f + MINMATCH)
+#define MAXLIT    0x80
+#define HASHBITS  10
+
+struct zent {
+  ushort ref;       // 0 if the entry is free
+  ushort len;       // compressed length
+  uchar pg;         // pool page
+  uchar chunk;      // first chunk
+};
+
+struct {
+  struct spinlock lock;
+  int enabled;
+  uchar *page[NZSWAP];          // pool pages, or 0
+  uint64 used[NZSWAP];          // chunks in use, a bit each
+  struct zent ent[NZENT];
+  uchar buf[PGSIZE];            // compressor output
+  ushort hash[1 << HASHBITS];   // compressor's recent positions, plus one
+} zswap;
+
+void
+zswapinit(void)
+{
+  initlock(&zswap.lock, "zswap");
+  zswap.enabled = 1;
+}
+
+static uint
+hash3(uchar *s)
+{
+  return ((s[0] << 16 | s[1] << 8 | s[2]) * 2654435761U) >> (32 - HASHBITS);
+}
+
+// Append literals src[0..n) to dst at *len.
+// Returns 0 if they would take dst past max bytes.
+static int
+literals(uchar *src, int n, uchar *dst, int *len, int max)
+{
+  int k;
+
+  while(n > 0){
+    k = n < MAXLIT ? n : MAXLIT;
+    if(*len + 1 + k > max)
+      return 0;
+    dst[(*len)++] = k - 1;
+    memmove(dst + *len, src, k);
+    *len += k;
+    src += k;
+    n -= k;
+  }
+  return 1;
+}
+
+// Compress the page at src into dst.
+// Returns the compressed length, or 0 if it is over max.
+static int
+compress(uchar *src, uchar *dst, int max)
+{
+  int i, lit, len, match, cand;
+  uint h;
+
+  memset(zswap.hash, 0, sizeof(zswap.hash));
+  len = 0;
+  lit = 0;
+  i = 0;
+  while(i + MINMATCH <= PGSIZE){
+    h = hash3(src + i);
+    cand = zswap.hash[h] - 1;
+    zswap.hash[h] = i + 1;
+    match = 0;
+    if(cand >= 0 && src[cand] == src[i] && src[cand+1] == src[i+1] &&
+       src[cand+2] == src[i+2]){
+      match = MINMATCH;
+      while(i + match < PGSIZE && match < MAXMATCH && src[cand+match] == src[i+match])
+        match++;
+    }
+    if(match == 0){
+      i++;
+      continue;
+    }
+    if(!literals(src + lit, i - lit, dst, &len, max) || len + 3 > max)
+      return 0;
+    dst[len++] = 0x80 | (match - MINMATCH);
+    dst[len++] = (i - cand) & 0xff;
+    dst[len++] = (i - cand) >> 8;
+    i += match;
+    lit = i;
+  }
+  if(!literals(src + lit, PGSIZE - lit, dst, &len, max))
+    return 0;
+  return len;
+}
+
+static void
+decompress(uchar *src, int len, uchar *dst)
+{
+  int i, n, c, k, off;
+
+  i = 0;
+  n = 0;
+  while(i < len){
+    c = src[i++];
+    if(c < 0x80){
+      for(k = 0; k <= c; k++)
+        dst[n++] = src[i++];
+    } else {
+      off = src[i] | src[i+1] << 8;
+      i += 2;
+      for(k = (c & 0x7f) + MINMATCH; k > 0; k--, n++)
+        dst[n] = dst[n - off];
+    }
+  }
+  if(n != PGSIZE)
+    panic("zswap: corrupt page");
+}
+
+// Find n free chunks in one pool page, adding a page to the
+// pool if need be. Returns 0 if the pool is full.
+static int
+chunkalloc(int n, struct zent *e)
+{
+  uint64 mask;
+  int pg, c, empty;
+
+  mask = (1L << n) - 1;
+  empty = -1;
+  for(pg = 0; pg < NZSWAP; pg++){
+    if(zswap.page[pg] == 0){
+      if(empty < 0)
+        empty = pg;
+      continue;
+    }
+    for(c = 0; c + n <= NCHUNK; c++){
+      if((zswap.used[pg] & (mask << c)) == 0)
+        goto found;
+    }
+  }
+  if(empty < 0 || (zswap.page[empty] = kalloc()) == 0)
+    return 0;
+  pg = empty;
+  c = 0;
+found:
+  zswap.used[pg] |= mask << c;
+  e->pg = pg;
+  e->chunk = c;
+  return 1;
+}
+
+static void
+chunkfree(struct zent *e)
+{
+  int n = (e->len + CHUNK - 1) / CHUNK;
+
+  zswap.used[e->pg] &= ~(((1L << n) - 1) << e->chunk);
+  if(zswap.used[e->pg] == 0){
+    kfree(zswap.page[e->pg]);
+    zswap.page[e->pg] = 0;
+  }
+}
+
+// Compress the page at pa into the pool.
+// Returns its handle, or 0 if it has to go to disk.
+int
+zswap_store(char *pa)
+{
+  struct zent *e;
+  int len, h;
+
+  h = 0;
+  acquire(&zswap.lock);
+  if(!zswap.enabled)
+    goto out;
+  for(e = zswap.ent; e < &zswap.ent[NZENT] && e->ref; e++)
+    ;
+  if(e == &zswap.ent[NZENT])
+    goto out;
+  if((len = compress((uchar*)pa, zswap.buf, MAXLEN)) == 0)
+    goto out;
+  if(!chunkalloc((len + CHUNK - 1) / CHUNK, e))
+    goto out;
+  memmove(zswap.page[e->pg] + e->chunk*CHUNK, zswap.buf, len);
+  e->len = len;
+  e->ref = 1;
+  h = e - zswap.ent + 1;
+out:
+  release(&zswap.lock);
+  return h;
+}
+
+// Decompress the page with handle h into pa.
+void
+zswap_load(int h, char *pa)
+{
+  struct zent *e = &zswap.ent[h-1];
+
+  acquire(&zswap.lock);
+  if(e->ref == 0)
+    panic("zswap_load");
+  decompress(zswap.page[e->pg] + e->chunk*CHUNK, e->len, (uchar*)pa);
+  release(&zswap.lock);
+}
+
+// Another swap slot holds the page with handle h.
+void
+zswap_dup(int h)
+{
+  acquire(&zswap.lock);
+  zswap.ent[h-1].ref++;
+  release(&zswap.lock);
+}
+
+// A swap slot no longer holds the page with handle h.
+void
+zswap_free(int h)
+{
+  struct zent *e = &zswap.ent[h-1];
+
+  acquire(&zswap.lock);
+  if(e->ref == 0)
+    panic("zswap_free");
+  if(--e->ref == 0)
+    chunkfree(e);
+  release(&zswap.lock);
+}
+
+// Turn the pool on or off for pages swapped out from now on.
+// Returns the old setting.
+int
+zswapctl(int on)
+{
+  int old;
+
+  acquire(&zswap.lock);
+  old = zswap.enabled;
+  zswap.enabled = on != 0;
+  release(&zswap.lock);
+  return old;
+}
+
+#endif
@@ -22,7 +22,10 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+// The log is a header block plus up to LOGSIZE blocks, but never
+// more than an eighth of the disk. The kernel sizes its transactions
+// from the nlog recorded in the super block.
+int nlog = (LOGSIZE+1 < FSSIZE/8) ? LOGSIZE+1 : FSSIZE/8;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -128,14 +131,12 @@ main(int argc, char *argv[])
   iappend(rootino, &de, sizeof(de));
 
   for(i = 2; i < argc; i++){
-    // get rid of "user/"
+    // get rid of "user/", "kernel/"
     char *shortname;
-    if(strncmp(argv[i], "user/", 5) == 0)
-      shortname = argv[i] + 5;
+    if((shortname = rindex(argv[i], '/')) != 0)
+      shortname++;
     else
       shortname = argv[i];
-    
-    assert(index(shortname, '/') == 0);
 
     if((fd = open(argv[i], 0)) < 0)
       die(argv[i]);
@@ -257,7 +258,8 @@ iappend(uint inum, void *xp, int n)
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  uint dindirect[NINDIRECT];
+  uint x, fdn;
 
   rinode(inum, &din);
   off = xint(din.size);
@@ -270,7 +272,7 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
-    } else {
+    } else if(fbn < NDIRECT + NINDIRECT){
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
       }
@@ -280,6 +282,22 @@ iappend(uint inum, void *xp, int n)
         wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
+    } else {
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)dindirect);
+      fdn = fbn - NDIRECT - NINDIRECT;
+      if(dindirect[fdn / NINDIRECT] == 0){
+        dindirect[fdn / NINDIRECT] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)dindirect);
+      }
+      rsect(xint(dindirect[fdn / NINDIRECT]), (char*)indirect);
+      if(indirect[fdn % NINDIRECT] == 0){
+        indirect[fdn % NINDIRECT] = xint(freeblock++);
+        wsect(xint(dindirect[fdn / NINDIRECT]), (char*)indirect);
+      }
+      x = xint(indirect[fdn % NINDIRECT]);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
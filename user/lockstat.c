@@ -0,0 +1,36 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+// print spinlock statistics, most time spent spinning first.
+
+struct lockstat ls[NLOCKSTAT];
+
+int
+main(int argc, char **argv)
+{
+  int i, j, n;
+  struct lockstat t;
+
+  if((n = lockstat(ls, NLOCKSTAT)) < 0){
+    fprintf(2, "lockstat: failed\n");
+    exit(1);
+  }
+
+  for(i = 0; i < n; i++){
+    for(j = i + 1; j < n; j++){
+      if(ls[j].spincycles > ls[i].spincycles){
+        t = ls[i];
+        ls[i] = ls[j];
+        ls[j] = t;
+      }
+    }
+  }
+
+  printf("name            acquires contended spin-cycles\n");
+  for(i = 0; i < n; i++)
+    printf("%s\t\t%l %l %l\n", ls[i].name, ls[i].nacquire,
+           ls[i].ncontend, ls[i].spincycles);
+  exit(0);
+}
@@ -0,0 +1,269 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/paging.h"
+#include "user/user.h"
+
+// pagebench: run access patterns over sbrk()'d memory that
+// is bigger than a process may keep in RAM, and report the
+// paging work each one causes.
+//
+// usage: pagebench [-d] [-p policy] [pattern ...]
+//
+// With paging on, the patterns run under each replacement
+// policy in turn, or just the one given with -p. -d sends
+// evicted pages straight to disk, rather than first to the
+// compressed swap pool. Each pattern
+// runs in its own child process, from a fixed random seed, so
+// runs under different policies touch the same pages in the
+// same order.
+
+#define NPAGES    (MAX_PSYC_PAGES + MAX_PSYC_PAGES/2)
+#define ACCESSES  2000
+#define STRIDE    5
+#define SEED      12345
+#define NELEM(x)  (sizeof(x)/sizeof((x)[0]))
+
+char *algos[] = PGPOLICY_NAMES;
+
+char *mem;
+int npages;
+uint rnd;
+
+// pseudo-random numbers, 24 bits at a time.
+uint
+random(void)
+{
+  rnd = rnd * 1103515245 + 12345;
+  return rnd >> 8;
+}
+
+void
+touch(int pg, int i)
+{
+  mem[pg*PGSIZE + (i*64) % PGSIZE]++;
+}
+
+// each page once, in order: first-touch faults only.
+void
+seq(void)
+{
+  int pg;
+
+  for(pg = 0; pg < npages; pg++)
+    touch(pg, pg);
+}
+
+// round and round all pages, more than fit in RAM.
+void
+loop(void)
+{
+  int i;
+
+  for(i = 0; i < ACCESSES; i++)
+    touch(i % npages, i);
+}
+
+void
+uniform(void)
+{
+  int i;
+
+  for(i = 0; i < ACCESSES; i++)
+    touch(random() % npages, i);
+}
+
+void
+strided(void)
+{
+  int i;
+
+  for(i = 0; i < ACCESSES; i++)
+    touch((i * STRIDE) % npages, i);
+}
+
+// page k is picked with probability proportional to 1/(k+1).
+void
+zipf(void)
+{
+  uint cum[NPAGES], total;
+  int i, pg;
+  uint r;
+
+  total = 0;
+  for(pg = 0; pg < npages; pg++){
+    total += 1000000 / (pg + 1);
+    cum[pg] = total;
+  }
+  for(i = 0; i < ACCESSES; i++){
+    r = random() % total;
+    for(pg = 0; cum[pg] <= r; pg++)
+      ;
+    touch(pg, i);
+  }
+}
+
+// a hot set of half the pages that fit in RAM, used three
+// times in four, mixed with a scan through the rest.
+void
+mix(void)
+{
+  int i, hot, scan;
+
+  hot = MAX_PSYC_PAGES / 2;
+  scan = 0;
+  for(i = 0; i < ACCESSES; i++){
+    if(i % 4 == 3){
+      touch(hot + scan, i);
+      scan = (scan + 1) % (npages - hot);
+    } else
+      touch(i % hot, i);
+  }
+}
+
+struct pattern {
+  char *name;
+  void (*f)(void);
+} patterns[] = {
+  { "seq", seq },
+  { "loop", loop },
+  { "random", uniform },
+  { "stride", strided },
+  { "zipf", zipf },
+  { "mix", mix },
+  { 0, 0 },
+};
+
+// run pattern t in a child process, and print its line.
+void
+run(struct pattern *t)
+{
+  struct pagestat before, after;
+  uint64 start, ns;
+  int pid, xstatus, ticks;
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pagebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    rnd = SEED;
+    if((mem = sbrk(npages * PGSIZE)) == (char*)-1){
+      fprintf(2, "pagebench: sbrk failed\n");
+      exit(1);
+    }
+    // seq measures the first touches; the others start
+    // with every page already allocated.
+    if(t->f != seq)
+      seq();
+    pagestat(0, &before);
+    ticks = uptime();
+    start = uptimens();
+    t->f();
+    ns = uptimens() - start;
+    ticks = uptime() - ticks;
+    pagestat(0, &after);
+    printf("%s\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%d\t%l\n", t->name,
+           after.faults - before.faults,
+           after.swapins - before.swapins,
+           after.swapouts - before.swapouts,
+           after.zswapins - before.zswapins,
+           after.zswapouts - before.zswapouts,
+           after.fillins - before.fillins,
+           after.fillouts - before.fillouts,
+           after.rescues - before.rescues,
+           after.evictions - before.evictions,
+           after.scans - before.scans,
+           after.rotations - before.rotations,
+           ticks, ns / 1000);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    fprintf(2, "pagebench: %s failed\n", t->name);
+}
+
+// run the patterns named in argv, or all of them, under policy.
+void
+runall(int policy, int argc, char *argv[])
+{
+  struct pattern *t;
+  int i;
+
+  if(policy != NONE && pagectl(PAGECTL_POLICY, policy) < 0){
+    fprintf(2, "pagebench: no policy %s\n", algos[policy]);
+    return;
+  }
+  printf("pagebench: policy %s, %d pages, %d fit in RAM\n",
+         algos[policy], npages, MAX_PSYC_PAGES);
+  printf("pattern\tfaults\tswapins\tswapouts\tzswapins\tzswapouts\tfillins\tfillouts\trescues\tevictions\tscans\trotations\tticks\tusec\n");
+  for(t = patterns; t->name; t++){
+    if(argc > 0){
+      for(i = 0; i < argc; i++)
+        if(strcmp(argv[i], t->name) == 0)
+          break;
+      if(i == argc)
+        continue;
+    }
+    run(t);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pagestat st;
+  int policy, limit, zswap;
+
+  if(pagestat(0, &st) < 0){
+    fprintf(2, "pagebench: pagestat failed\n");
+    exit(1);
+  }
+  // leave room under the resident limit plus the swap file
+  // for the program itself.
+  npages = NPAGES;
+  limit = st.limit + MAX_PAGED_PAGES - 1 - PGROUNDUP((uint64)sbrk(0)) / PGSIZE;
+  if(npages > limit)
+    npages = limit;
+
+  argc--;
+  argv++;
+  policy = -1;
+  zswap = 1;
+  while(argc > 0 && argv[0][0] == '-'){
+    if(strcmp(argv[0], "-d") == 0){
+      zswap = 0;
+      argc--;
+      argv++;
+    } else if(argc >= 2 && strcmp(argv[0], "-p") == 0){
+      for(policy = NELEM(algos) - 1; policy > NONE; policy--)
+        if(strcmp(argv[1], algos[policy]) == 0)
+          break;
+      if(policy == NONE){
+        fprintf(2, "pagebench: unknown policy %s\n", argv[1]);
+        exit(1);
+      }
+      argc -= 2;
+      argv += 2;
+    } else {
+      fprintf(2, "usage: pagebench [-d] [-p policy] [pattern ...]\n");
+      exit(1);
+    }
+  }
+
+  // the pool is shared by the whole system: put it back after.
+  if(st.algo != NONE)
+    zswap = pagectl(PAGECTL_ZSWAP, zswap);
+  if(st.algo == NONE)
+    runall(NONE, argc, argv);
+  else if(policy > 0)
+    runall(policy, argc, argv);
+  else {
+    for(policy = 1; policy < NELEM(algos); policy++)
+      runall(policy, argc, argv);
+  }
+  if(st.algo != NONE)
+    pagectl(PAGECTL_ZSWAP, zswap);
+  exit(0);
+}
@@ -0,0 +1,96 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/paging.h"
+#include "user/user.h"
+
+// pagestat: print the paging statistics of a process, or
+// totals for the whole system, with a histogram of how long
+// page faults took to service.
+//
+// usage: pagestat [pid]
+
+#define BAR  40
+
+char *algos[] = PGPOLICY_NAMES;
+
+void
+counter(char *name, uint64 n)
+{
+  printf("%s\t%l\n", name, n);
+}
+
+void
+histogram(struct pagestat *st)
+{
+  uint64 max;
+  int k, lo, hi, i;
+
+  max = 0;
+  lo = NFAULTLAT;
+  hi = -1;
+  for(k = 0; k < NFAULTLAT; k++){
+    if(st->faultlat[k] == 0)
+      continue;
+    if(lo > k)
+      lo = k;
+    hi = k;
+    if(st->faultlat[k] > max)
+      max = st->faultlat[k];
+  }
+  if(hi < 0)
+    return;
+  printf("fault service time, cycles:\n");
+  for(k = lo; k <= hi; k++){
+    if(k < NFAULTLAT - 1)
+      printf("  < %l\t%l\t", (uint64)FAULTLAT_MIN << k, st->faultlat[k]);
+    else
+      printf(" >= %l\t%l\t", (uint64)FAULTLAT_MIN << (k-1), st->faultlat[k]);
+    for(i = 0; i < (st->faultlat[k] * BAR + max - 1) / max; i++)
+      printf("#");
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pagestat st;
+  int pid;
+
+  if(argc > 2){
+    fprintf(2, "usage: pagestat [pid]\n");
+    exit(1);
+  }
+  pid = argc == 2 ? atoi(argv[1]) : -1;
+  if(pagestat(pid, &st) < 0){
+    fprintf(2, "pagestat: no process %d\n", pid);
+    exit(1);
+  }
+
+  if(pid < 0)
+    printf("system: policy %s, %d pages in memory\n",
+           algos[st.algo], st.resident);
+  else if(st.pinned)
+    printf("pid %d: not paged\n", pid);
+  else
+    printf("pid %d: policy %s, %d of %d pages in memory\n",
+           pid, algos[st.policy], st.resident, st.limit);
+  if(pid >= 0 && !st.pinned && st.policy == ARC)
+    printf("  %d used again (T2), target %d used once (T1)\n",
+           st.arct2, st.arctarget);
+  counter("faults", st.faults);
+  counter("swapins", st.swapins);
+  counter("swapouts", st.swapouts);
+  counter("zswapins", st.zswapins);
+  counter("zswapouts", st.zswapouts);
+  counter("fillins", st.fillins);
+  counter("fillouts", st.fillouts);
+  counter("rescues", st.rescues);
+  counter("evictions", st.evictions);
+  counter("scans", st.scans);
+  counter("rotations", st.rotations);
+  counter("sweeps", st.sweeps);
+  counter("ghosthits", st.ghosthits);
+  histogram(&st);
+  exit(0);
+}
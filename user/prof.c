@@ -0,0 +1,247 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+// prof: run a command with the sampling profiler on, and print
+// a flat profile of where the CPUs spent their time, in the
+// kernel and in user programs, by function.
+//
+// usage: prof command [arg ...]
+//
+// Functions come from kernel.sym and the programs' .sym files,
+// which the Makefile puts in the file system. The profile
+// covers everything that ran meanwhile, not just the command.
+
+#define NREC  64
+#define NHIT  512   // distinct places sampled
+#define NSYM  32
+
+// samples at one pc of one program, and then at one function.
+struct hit {
+  char prog[16];      // program name, or "kernel"
+  uint64 pc;
+  char fn[NSYM];      // function the pc is in, once resolved
+  uint64 sym;         // its address
+  int resolved;
+  int n;
+};
+
+struct hit hits[NHIT];
+int nhit;
+int nsample;
+int other;            // samples that didn't fit in hits[]
+struct profsample rec[NREC];
+
+void
+add(struct profsample *s)
+{
+  char *prog = s->user ? s->name : "kernel";
+  struct hit *h;
+
+  nsample++;
+  for(h = hits; h < &hits[nhit]; h++){
+    if(h->pc == s->pc && strcmp(h->prog, prog) == 0){
+      h->n++;
+      return;
+    }
+  }
+  if(nhit == NHIT){
+    other++;
+    return;
+  }
+  h = &hits[nhit++];
+  strcpy(h->prog, prog);
+  h->pc = s->pc;
+  h->n = 1;
+}
+
+// read a line of fd into buf, buffered.
+// returns 0 at end of file.
+int
+getline(int fd, char *buf, int max)
+{
+  static char in[512];
+  static int pos, len;
+  int i;
+
+  i = 0;
+  for(;;){
+    if(pos == len){
+      if((len = read(fd, in, sizeof(in))) <= 0){
+        pos = len = 0;
+        break;
+      }
+      pos = 0;
+    }
+    if(in[pos] == '\n'){
+      pos++;
+      break;
+    }
+    if(i < max - 1)
+      buf[i++] = in[pos];
+    pos++;
+  }
+  buf[i] = 0;
+  return i > 0 || len > 0;
+}
+
+uint64
+hex(char *s)
+{
+  uint64 x = 0;
+
+  for(; *s; s++){
+    if(*s >= '0' && *s <= '9')
+      x = x*16 + *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      x = x*16 + *s - 'a' + 10;
+    else
+      break;
+  }
+  return x;
+}
+
+// names of sections, source files and mapping symbols
+// aren't functions.
+int
+isfunc(char *name)
+{
+  int n = strlen(name);
+
+  if(name[0] == '.' || name[0] == '$' || name[0] == 0)
+    return 0;
+  if(n > 2 && name[n-2] == '.' && (name[n-1] == 'c' || name[n-1] == 'S'))
+    return 0;
+  return 1;
+}
+
+// find the function of each hit in prog, from prog.sym:
+// the closest symbol at or below its pc.
+void
+resolve(char *prog)
+{
+  char path[32], line[128], *name;
+  uint64 addr;
+  struct hit *h;
+  int fd, i;
+
+  strcpy(path, prog);
+  strcpy(path + strlen(path), ".sym");
+  fd = open(path, O_RDONLY);
+  for(h = hits; h < &hits[nhit]; h++){
+    if(!h->resolved && strcmp(h->prog, prog) == 0){
+      h->resolved = 1;
+      strcpy(h->fn, "?");
+      h->sym = 0;
+    }
+  }
+  if(fd < 0)
+    return;
+  while(getline(fd, line, sizeof(line))){
+    if((name = strchr(line, ' ')) == 0)
+      continue;
+    *name++ = 0;
+    if(!isfunc(name))
+      continue;
+    addr = hex(line);
+    for(h = hits; h < &hits[nhit]; h++){
+      if(strcmp(h->prog, prog) == 0 && addr <= h->pc && addr >= h->sym){
+        h->sym = addr;
+        for(i = 0; i < NSYM-1 && name[i]; i++)
+          h->fn[i] = name[i];
+        h->fn[i] = 0;
+      }
+    }
+  }
+  close(fd);
+}
+
+// fold the hits in the same function together, and sort
+// them, most samples first.
+void
+fold(void)
+{
+  struct hit *h, *g, t;
+  int n;
+
+  n = 0;
+  for(h = hits; h < &hits[nhit]; h++){
+    for(g = hits; g < &hits[n]; g++){
+      if(strcmp(g->prog, h->prog) == 0 && strcmp(g->fn, h->fn) == 0){
+        g->n += h->n;
+        break;
+      }
+    }
+    if(g == &hits[n])
+      hits[n++] = *h;
+  }
+  nhit = n;
+  for(h = hits; h < &hits[nhit]; h++){
+    for(g = h + 1; g < &hits[nhit]; g++){
+      if(g->n > h->n){
+        t = *h;
+        *h = *g;
+        *g = t;
+      }
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct hit *h;
+  uint64 lost;
+  int i, n, pid, xstatus;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [arg ...]\n");
+    exit(1);
+  }
+
+  // on before the runner starts, so that profread() doesn't
+  // see it off and stop at once.
+  profctl(1);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if((pid = fork()) == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "prof: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(&xstatus);
+    profctl(0);
+    exit(xstatus);
+  }
+
+  lost = 0;
+  while((n = profread(rec, NREC, &lost)) > 0){
+    for(i = 0; i < n; i++)
+      add(&rec[i]);
+  }
+  if(n < 0)
+    fprintf(2, "prof: profread failed\n");
+  wait(0);
+
+  for(h = hits; h < &hits[nhit]; h++)
+    if(!h->resolved)
+      resolve(h->prog);
+  fold();
+
+  printf("prof: %d samples, %l lost\n", nsample, lost);
+  if(nsample == 0)
+    exit(0);
+  printf("%%\tsamples\tprogram\tfunction\n");
+  for(h = hits; h < &hits[nhit]; h++)
+    printf("%d.%d\t%d\t%s\t%s\n", h->n * 100 / nsample, h->n * 1000 / nsample % 10,
+           h->n, h->prog, h->fn);
+  if(other)
+    printf("\t%d\telsewhere\n", other);
+  exit(0);
+}
@@ -1,8 +1,10 @@
 // Shell.
 
 #include "kernel/types.h"
+#include "kernel/param.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/paging.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -76,6 +78,8 @@ runcmd(struct cmd *cmd)
     ecmd = (struct execcmd*)cmd;
     if(ecmd->argv[0] == 0)
       exit(1);
+    // the shell itself is pinned, but the commands it runs are paged.
+    pagectl(PAGECTL_PIN, 0);
     exec(ecmd->argv[0], ecmd->argv);
     fprintf(2, "exec %s failed\n", ecmd->argv[0]);
     break;
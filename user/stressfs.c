@@ -12,6 +12,38 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/ioring.h"
+
+// Queue an operation on the I/O ring.
+void
+queue(struct ioring *r, int op, int fd, void *addr, int n)
+{
+  struct io_sqe *e = &r->sq[r->sqtail % IORING_ENTRIES];
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->n = n;
+  e->data = r->sqtail;
+  r->sqtail++;
+}
+
+// Run everything queued on the ring, a batch per system call.
+// Returns the number of operations that failed.
+int
+drain(struct ioring *r)
+{
+  int bad = 0;
+
+  while(r->sqhead != r->sqtail){
+    if(ioring_enter() < 0)
+      return -1;
+    for(; r->cqhead != r->cqtail; r->cqhead++)
+      if(r->cq[r->cqhead % IORING_ENTRIES].res < 0)
+        bad++;
+  }
+  return bad;
+}
 
 int
 main(int argc, char *argv[])
@@ -19,6 +51,7 @@ main(int argc, char *argv[])
   int fd, i;
   char path[] = "stressfs0";
   char data[512];
+  struct ioring *r;
 
   printf("stressfs starting\n");
   memset(data, 'a', sizeof(data));
@@ -30,18 +63,27 @@ main(int argc, char *argv[])
   printf("write %d\n", i);
 
   path[8] += i;
+  if((r = ioring_setup()) == (struct ioring*)-1){
+    printf("stressfs: ioring_setup failed\n");
+    exit(1);
+  }
+
+  // the writes and the close go to the kernel in one batch.
   fd = open(path, O_CREATE | O_RDWR);
   for(i = 0; i < 20; i++)
-//    printf(fd, "%d\n", i);
-    write(fd, data, sizeof(data));
-  close(fd);
+    queue(r, IORING_OP_WRITE, fd, data, sizeof(data));
+  queue(r, IORING_OP_CLOSE, fd, 0, 0);
+  if(drain(r) != 0)
+    printf("stressfs: write failed\n");
 
   printf("read\n");
 
   fd = open(path, O_RDONLY);
   for (i = 0; i < 20; i++)
-    read(fd, data, sizeof(data));
-  close(fd);
+    queue(r, IORING_OP_READ, fd, data, sizeof(data));
+  queue(r, IORING_OP_CLOSE, fd, 0, 0);
+  if(drain(r) != 0)
+    printf("stressfs: read failed\n");
 
   wait(0);
 
@@ -0,0 +1,261 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/syscall.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+// trace: turn kernel event tracing on or off, or print the
+// events buffered so far, or trace one command.
+//
+// usage: trace [-t usec] [on | off | command [arg ...]]
+//
+// Each event that ends something (a system call, a page fault,
+// a disk request, a log commit) also shows how long that took,
+// and -t prints only the ones that took at least usec.
+
+#define NREC   64
+#define NOPEN  64
+#define NELEM(x)  (sizeof(x)/sizeof((x)[0]))
+
+char *events[] = {
+[TR_LOST]       "lost",
+[TR_RUN]        "run",
+[TR_STOP]       "stop",
+[TR_SYSCALL]    "syscall",
+[TR_SYSRET]     "sysret",
+[TR_FAULT]      "fault",
+[TR_FAULTDONE]  "faultdone",
+[TR_SWAPOUT]    "swapout",
+[TR_DISK]       "disk",
+[TR_DISKDONE]   "diskdone",
+[TR_BEGINOP]    "beginop",
+[TR_COMMIT]     "commit",
+[TR_COMMITDONE] "commitdone",
+};
+
+char *syscalls[] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_sleepns] "sleepns",
+[SYS_uptimens] "uptimens",
+[SYS_lockstat] "lockstat",
+[SYS_ioring_setup] "ioring_setup",
+[SYS_ioring_enter] "ioring_enter",
+[SYS_readv]   "readv",
+[SYS_writev]  "writev",
+[SYS_pread]   "pread",
+[SYS_pwrite]  "pwrite",
+[SYS_mmap]    "mmap",
+[SYS_munmap]  "munmap",
+[SYS_pagestat] "pagestat",
+[SYS_pagectl] "pagectl",
+[SYS_tracectl] "tracectl",
+[SYS_traceread] "traceread",
+[SYS_profctl] "profctl",
+[SYS_profread] "profread",
+};
+
+char *states[] = { "unused", "used", "sleep", "runnable", "run", "zombie" };
+
+// the starts of things not yet ended, by the event that
+// starts them and a key, hashed; a collision forgets one.
+struct start {
+  int type;
+  uint64 key;
+  uint64 time;
+} starts[NOPEN];
+
+struct tracerec rec[NREC];
+uint64 t0;
+uint64 slow;        // -t usec
+
+char*
+name(char **names, int n, int i)
+{
+  if(i >= 0 && i < n && names[i])
+    return names[i];
+  return "?";
+}
+
+struct start*
+slot(int type, uint64 key)
+{
+  return &starts[(type * 31 + key) % NOPEN];
+}
+
+void
+begin(struct tracerec *e, uint64 key)
+{
+  struct start *s = slot(e->type, key);
+
+  s->type = e->type;
+  s->key = key;
+  s->time = e->time;
+}
+
+// cycles since the start of type with key, or -1 if unknown.
+long
+since(struct tracerec *e, int type, uint64 key)
+{
+  struct start *s = slot(type, key);
+
+  if(s->type != type || s->key != key)
+    return -1;
+  s->type = 0;
+  return e->time - s->time;
+}
+
+void
+print(struct tracerec *e)
+{
+  long d;
+
+  d = -1;
+  switch(e->type){
+  case TR_SYSCALL:
+  case TR_FAULT:
+    begin(e, e->pid);
+    break;
+  case TR_DISK:
+    begin(e, e->a0);
+    break;
+  case TR_COMMIT:
+    begin(e, 0);
+    break;
+  case TR_SYSRET:
+    d = since(e, TR_SYSCALL, e->pid);
+    break;
+  case TR_FAULTDONE:
+    d = since(e, TR_FAULT, e->pid);
+    break;
+  case TR_DISKDONE:
+    d = since(e, TR_DISK, e->a0);
+    break;
+  case TR_COMMITDONE:
+    d = since(e, TR_COMMIT, 0);
+    break;
+  }
+  if(d >= 0)
+    d = d * NS_PER_CYCLE / 1000;
+  if(slow > 0 && (d < 0 || d < slow))
+    return;
+
+  if(t0 == 0)
+    t0 = e->time;
+  printf("%l\t%d\t%d\t%s", (e->time - t0) * NS_PER_CYCLE / 1000,
+         e->cpu, e->pid, name(events, NELEM(events), e->type));
+  switch(e->type){
+  case TR_LOST:
+    printf(" %l events", e->a0);
+    break;
+  case TR_STOP:
+    printf(" %s", name(states, NELEM(states), e->a0));
+    break;
+  case TR_SYSCALL:
+    printf(" %s", name(syscalls, NELEM(syscalls), e->a0));
+    break;
+  case TR_SYSRET:
+    printf(" %s = %d", name(syscalls, NELEM(syscalls), e->a0), (int)e->a1);
+    break;
+  case TR_FAULT:
+  case TR_SWAPOUT:
+    printf(" %p", e->a0);
+    break;
+  case TR_FAULTDONE:
+    printf(" %p%s", e->a0, e->a1 ? "" : " bad");
+    break;
+  case TR_DISK:
+    printf(" %s %l", e->a1 ? "write" : "read", e->a0);
+    break;
+  case TR_DISKDONE:
+    printf(" %l", e->a0);
+    break;
+  case TR_BEGINOP:
+    printf(" %l outstanding, waited %l", e->a0, e->a1);
+    break;
+  case TR_COMMIT:
+    printf(" %l blocks", e->a0);
+    break;
+  }
+  if(d >= 0)
+    printf(" (%l usec)", d);
+  printf("\n");
+}
+
+// read the buffered events, printing them if show is set,
+// with tracing off so that this doesn't make more.
+void
+drain(int show)
+{
+  int i, n, on;
+
+  on = tracectl(0);
+  if(show)
+    printf("usec\tcpu\tpid\tevent\n");
+  while((n = traceread(rec, NREC)) > 0){
+    for(i = 0; show && i < n; i++)
+      print(&rec[i]);
+  }
+  if(n < 0)
+    fprintf(2, "trace: traceread failed\n");
+  tracectl(on);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  argc--;
+  argv++;
+  if(argc >= 2 && strcmp(argv[0], "-t") == 0){
+    slow = atoi(argv[1]);
+    argc -= 2;
+    argv += 2;
+  }
+
+  if(argc == 0){
+    drain(1);
+  } else if(strcmp(argv[0], "on") == 0){
+    tracectl(1);
+  } else if(strcmp(argv[0], "off") == 0){
+    tracectl(0);
+  } else {
+    drain(0);
+    tracectl(1);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "trace: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[0], argv);
+      fprintf(2, "trace: exec %s failed\n", argv[0]);
+      exit(1);
+    }
+    wait(0);
+    tracectl(0);
+    drain(1);
+  }
+  exit(0);
+}
@@ -3,88 +3,214 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator with size classes.
+//
+// Memory comes from sbrk() in page-aligned spans of whole
+// pages, each starting with a struct span. Small blocks are
+// carved out of one-page spans that each hold blocks of a
+// single size class: malloc() takes a block from the span's
+// free list, or else bumps the span's never-used pointer.
+// Larger blocks get a span of their own. Because spans are
+// page aligned, free() finds a block's span by rounding down.
+//
+// Spans no longer in use go back to an address-ordered list
+// of free page runs, and a large enough free run at the top
+// of the heap is given back to the kernel with a negative sbrk().
 
-typedef long Align;
+#define PAGE      4096
+#define NCLASS    7                 // 16, 32, ..., 1024 bytes
+#define MAXSMALL  (16 << (NCLASS-1))
+#define LARGE     NCLASS            // class of a span for one large block
+#define TRIMPAGES 2                 // smallest free run to give back
 
-union header {
-  struct {
-    union header *ptr;
-    uint size;
-  } s;
-  Align x;
+struct span {
+  struct span *next;   // on partial[] or on the free runs
+  struct span *prev;   // on partial[]
+  char *free;          // freed blocks, linked through their first word
+  char *bump;          // first block never handed out
+  ushort class;        // size class, or LARGE
+  ushort nused;        // blocks handed out and not yet freed
+  uint npages;         // pages in this span
 };
 
-typedef union header Header;
+// blocks start this far into a span, keeping them 16-byte aligned.
+#define HDRSIZE ((sizeof(struct span) + 15) & ~15)
 
-static Header base;
-static Header *freep;
+static struct span *partial[NCLASS];  // spans with room, per class
+static struct span *runs;             // free page runs, by address
 
-void
-free(void *ap)
+static uint
+blocksize(int c)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  return 16 << c;
 }
 
-static Header*
-morecore(uint nu)
+static int
+sizeclass(uint n)
 {
-  char *p;
-  Header *hp;
+  int c;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
+  for(c = 0; blocksize(c) < n; c++)
+    ;
+  return c;
+}
+
+// Is small-block span s out of room?
+static int
+full(struct span *s)
+{
+  return s->free == 0 && s->bump + blocksize(s->class) > (char*)s + PAGE;
+}
+
+// Take a span of n pages from the free runs, or the kernel.
+static struct span*
+getpages(uint n)
+{
+  struct span *s, **sp;
+  char *top;
+  uint pad;
+
+  for(sp = &runs; (s = *sp) != 0; sp = &s->next){
+    if(s->npages == n){
+      *sp = s->next;
+      return s;
+    }
+    if(s->npages > n){
+      // take the top of the run, leaving the rest in place.
+      s->npages -= n;
+      s = (struct span*)((char*)s + s->npages*PAGE);
+      s->npages = n;
+      return s;
+    }
+  }
+
+  top = sbrk(0);
+  pad = (PAGE - (uint64)top % PAGE) % PAGE;
+  if(sbrk(pad + n*PAGE) == (char*)-1)
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  s = (struct span*)(top + pad);
+  s->npages = n;
+  return s;
+}
+
+// Give back span s, merging it with neighbouring free runs.
+// If that leaves a big enough free run at the top of the
+// heap, return it to the kernel.
+static void
+putpages(struct span *s)
+{
+  struct span *p, *q, **sp;
+
+  p = 0;
+  for(sp = &runs; (q = *sp) != 0 && q < s; sp = &q->next)
+    p = q;
+  s->next = q;
+  *sp = s;
+  if(q && (char*)s + s->npages*PAGE == (char*)q){
+    s->npages += q->npages;
+    s->next = q->next;
+  }
+  if(p && (char*)p + p->npages*PAGE == (char*)s){
+    p->npages += s->npages;
+    p->next = s->next;
+    s = p;
+  }
+
+  if(s->next == 0 && s->npages >= TRIMPAGES &&
+     (char*)s + s->npages*PAGE == sbrk(0) &&
+     sbrk(-(int)(s->npages*PAGE)) != (char*)-1){
+    for(sp = &runs; *sp != s; sp = &(*sp)->next)
+      ;
+    *sp = 0;
+  }
+}
+
+// Take s off its class's list of spans with room.
+static void
+partialdel(struct span *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    partial[s->class] = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Put s on its class's list of spans with room.
+static void
+partialadd(struct span *s)
+{
+  s->prev = 0;
+  s->next = partial[s->class];
+  if(s->next)
+    s->next->prev = s;
+  partial[s->class] = s;
+}
+
+void
+free(void *ap)
+{
+  struct span *s;
+  int wasfull;
+
+  if(ap == 0)
+    return;
+  s = (struct span*)((uint64)ap & ~(uint64)(PAGE-1));
+  if(s->class == LARGE){
+    putpages(s);
+    return;
+  }
+
+  wasfull = full(s);
+  *(char**)ap = s->free;
+  s->free = ap;
+  s->nused--;
+  if(wasfull)
+    partialadd(s);
+  // keep one empty span per class, so that a malloc/free
+  // loop doesn't get and put a page each time around.
+  if(s->nused == 0 && (s->next != 0 || s->prev != 0)){
+    partialdel(s);
+    putpages(s);
+  }
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  struct span *s;
+  char *p;
+  int c;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
+  if(nbytes > MAXSMALL){
+    if(nbytes > 0x7fffffff - HDRSIZE - PAGE)
+      return 0;
+    if((s = getpages((nbytes + HDRSIZE + PAGE - 1) / PAGE)) == 0)
+      return 0;
+    s->class = LARGE;
+    return (char*)s + HDRSIZE;
   }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
-    }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+
+  c = sizeclass(nbytes);
+  if((s = partial[c]) == 0){
+    if((s = getpages(1)) == 0)
+      return 0;
+    s->class = c;
+    s->nused = 0;
+    s->free = 0;
+    s->bump = (char*)s + HDRSIZE;
+    partialadd(s);
+  }
+  if(s->free){
+    p = s->free;
+    s->free = *(char**)p;
+  } else {
+    p = s->bump;
+    s->bump += blocksize(c);
   }
+  s->nused++;
+  if(full(s))
+    partialdel(s);
+  return p;
 }
@@ -1,4 +1,11 @@
 struct stat;
+struct lockstat;
+struct iovec;
+struct arena;
+struct pagestat;
+struct ioring;
+struct tracerec;
+struct profsample;
 
 // system calls
 int fork(void);
@@ -22,6 +29,23 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int sleepns(uint64);
+uint64 uptimens(void);
+int lockstat(struct lockstat*, int);
+struct ioring* ioring_setup(void);
+int ioring_enter(void);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+void* mmap(void*, uint, int, int, int, int);
+int munmap(void*, uint);
+int pagestat(int, struct pagestat*);
+int pagectl(int, int);
+int tracectl(int);
+int traceread(struct tracerec*, int);
+int profctl(int);
+int profread(struct profsample*, int, uint64*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -42,4 +66,9 @@ void *memcpy(void *, const void *, uint);
 void* ustack_malloc(uint);
 int ustack_free(void);
 
-#define MAXSIZE 512
\ No newline at end of file
+// ustack.c
+struct arena* arena_get(char*);
+void* arena_alloc(struct arena*, uint, uint);
+void* arena_mark(struct arena*);
+void arena_release(struct arena*, void*);
+void arena_reset(struct arena*);
\ No newline at end of file
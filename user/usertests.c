@@ -7,6 +7,11 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/ioring.h"
+#include "kernel/uio.h"
+#include "kernel/paging.h"
+#include "kernel/trace.h"
+#include "kernel/prof.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -574,6 +579,10 @@ writetest(char *s)
   }
 }
 
+// enough blocks to need the double-indirect block,
+// without filling the disk.
+#define BIGBLOCKS (NDIRECT+NINDIRECT+100)
+
 void
 writebig(char *s)
 {
@@ -585,7 +594,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -605,7 +614,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGBLOCKS){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -2570,6 +2579,1037 @@ badarg(char *s)
   exit(0);
 }
 
+// does sleepns() sleep at least as long as asked, and do
+// uptime() and uptimens() agree?
+void
+sleepnstest(char *s)
+{
+  uint64 t0, t1;
+  int tick0;
+
+  tick0 = uptime();
+  t0 = uptimens();
+  if(sleepns(50000000) < 0){
+    printf("%s: sleepns failed\n", s);
+    exit(1);
+  }
+  t1 = uptimens();
+  if(t1 - t0 < 50000000){
+    printf("%s: slept only %d ns\n", s, (int)(t1 - t0));
+    exit(1);
+  }
+  if(uptime() < tick0 || uptime() > t1 / 100000000 + 1){
+    printf("%s: uptime %d disagrees with uptimens\n", s, uptime());
+    exit(1);
+  }
+}
+
+// getpid() and uptime() read the USYSCALL page rather than
+// trapping; do they agree with the kernel, and is the page
+// read-only?
+void
+usyscall(char *s)
+{
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(getpid() != *(int*)USYSCALL)
+      exit(1);
+    sleep(2);
+    if(uptime() == 0)
+      exit(1);
+    exit(getpid());
+  }
+  wait(&xstatus);
+  if(xstatus != pid){
+    printf("%s: child getpid() %d, expected %d\n", s, xstatus, pid);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile int*)USYSCALL = 0;
+    printf("%s: oops could write USYSCALL page\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1)  // did kernel kill child?
+    exit(1);
+}
+
+// submit an operation on the I/O ring.
+static void
+ringop(struct ioring *r, int op, int fd, uint64 addr, int n)
+{
+  struct io_sqe *e = &r->sq[r->sqtail % IORING_ENTRIES];
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = addr;
+  e->n = n;
+  e->data = 1000 + r->sqtail;
+  r->sqtail++;
+}
+
+// do operations queued on the I/O ring run in order,
+// with the same results as the system calls?
+void
+ioring(char *s)
+{
+  struct ioring *r;
+  char *name = "ioring.txt";
+  char buf[16];
+  int fd, i;
+
+  r = ioring_setup();
+  if(r == (struct ioring*)-1){
+    printf("%s: ioring_setup failed\n", s);
+    exit(1);
+  }
+
+  // the first open is assigned the lowest free fd, which we
+  // need to know ahead of time for the write and close.
+  fd = dup(0);
+  close(fd);
+  ringop(r, IORING_OP_OPEN, 0, (uint64)name, O_CREATE|O_RDWR);
+  ringop(r, IORING_OP_WRITE, fd, (uint64)"hello", 5);
+  ringop(r, IORING_OP_CLOSE, fd, 0, 0);
+  ringop(r, IORING_OP_OPEN, 0, (uint64)name, O_RDONLY);
+  ringop(r, IORING_OP_READ, fd, (uint64)buf, sizeof(buf));
+  ringop(r, IORING_OP_CLOSE, fd, 0, 0);
+  ringop(r, IORING_OP_CLOSE, fd, 0, 0);
+  if(ioring_enter() != 7){
+    printf("%s: ioring_enter didn't run everything\n", s);
+    exit(1);
+  }
+  int want[] = { fd, 5, 0, fd, 5, 0, -1 };
+  for(i = 0; i < 7; i++){
+    struct io_cqe *c = &r->cq[r->cqhead % IORING_ENTRIES];
+    if(c->data != 1000 + i || c->res != want[i]){
+      printf("%s: completion %d: data %d res %d\n", s, i, (int)c->data, c->res);
+      exit(1);
+    }
+    r->cqhead++;
+  }
+  if(memcmp(buf, "hello", 5) != 0){
+    printf("%s: read back wrong data\n", s);
+    exit(1);
+  }
+  unlink(name);
+}
+
+// do readv/writev gather and scatter in order, and do
+// pread/pwrite leave the file offset alone?
+void
+vectorio(char *s)
+{
+  struct iovec iov[3];
+  char a[4], b[8], c[16];
+  int fd;
+
+  fd = open("vectorio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = "defgh";
+  iov[1].iov_len = 5;
+  iov[2].iov_base = "ij";
+  iov[2].iov_len = 2;
+  if(writev(fd, iov, 3) != 10){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "XY", 2, 3) != 2){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  // the offset is still 10, at the end of the file.
+  if(read(fd, c, sizeof(c)) != 0){
+    printf("%s: pwrite moved the offset\n", s);
+    exit(1);
+  }
+  memset(c, 0, sizeof(c));
+  if(pread(fd, c, sizeof(c), 0) != 10 || memcmp(c, "abcXYfghij", 10) != 0){
+    printf("%s: pread read back wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("vectorio", O_RDONLY);
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof(b);
+  if(readv(fd, iov, 2) != 10){
+    printf("%s: readv failed\n", s);
+    exit(1);
+  }
+  if(memcmp(a, "abcX", 4) != 0 || memcmp(b, "Yfghij", 6) != 0){
+    printf("%s: readv scattered wrong data\n", s);
+    exit(1);
+  }
+  if(readv(fd, iov, IOV_MAX+1) != -1){
+    printf("%s: readv took too many buffers\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("vectorio");
+}
+
+// arena allocations, alignment, multi-page buffers, and
+// giving pages back with arena_reset() and ustack_free().
+void
+arenatest(char *s)
+{
+  struct arena *a;
+  char *top, *p, *q, *mark;
+  int i;
+
+  top = sbrk(0);
+  a = arena_get("arenatest");
+  if(a == 0 || arena_get("arenatest") != a){
+    printf("%s: arena_get failed\n", s);
+    exit(1);
+  }
+  p = arena_alloc(a, 3, 0);
+  q = arena_alloc(a, 10, 256);
+  if(p == 0 || q == 0 || (uint64)q % 256 != 0 || q < p + 3){
+    printf("%s: bad small allocations\n", s);
+    exit(1);
+  }
+  mark = arena_mark(a);
+  p = arena_alloc(a, 5*PGSIZE, 0);
+  if(p == 0){
+    printf("%s: multi-page allocation failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 5*PGSIZE; i += PGSIZE)
+    p[i] = 1;
+  arena_release(a, mark);
+  if(arena_alloc(a, 1, 1) != mark){
+    printf("%s: release didn't rewind to the mark\n", s);
+    exit(1);
+  }
+  arena_reset(a);
+  if(sbrk(0) != top){
+    printf("%s: reset didn't give back the pages\n", s);
+    exit(1);
+  }
+
+  p = ustack_malloc(2*PGSIZE);
+  q = ustack_malloc(100);
+  if(p == (char*)-1 || q == (char*)-1 || q < p + 2*PGSIZE){
+    printf("%s: ustack_malloc failed\n", s);
+    exit(1);
+  }
+  if(ustack_free() != 0 || ustack_free() != 0 || ustack_free() != -1){
+    printf("%s: ustack_free failed\n", s);
+    exit(1);
+  }
+  if(sbrk(0) != top){
+    printf("%s: ustack_free didn't give back the pages\n", s);
+    exit(1);
+  }
+}
+
+#define MMAPPAGES 24
+
+// anonymous and file mmap() regions: contents, write-back of
+// MAP_SHARED pages, sharing with a child, and more file
+// pages than a process may keep in memory.
+void
+mmaptest(char *s)
+{
+  char *a, *b, buf[16];
+  int fd, i, pid, xstatus;
+
+  a = mmap(0, 3*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(a == (char*)-1){
+    printf("%s: anonymous mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3*PGSIZE; i += PGSIZE){
+    if(a[i] != 0){
+      printf("%s: anonymous page not zeroed\n", s);
+      exit(1);
+    }
+    a[i] = i / PGSIZE + 1;
+  }
+  for(i = 0; i < 3*PGSIZE; i += PGSIZE)
+    if(a[i] != i / PGSIZE + 1){
+      printf("%s: anonymous page lost a write\n", s);
+      exit(1);
+    }
+  if(munmap(a + PGSIZE, PGSIZE) != 0 || munmap(a, PGSIZE) != 0 ||
+     munmap(a + 2*PGSIZE, PGSIZE) != 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  // a shared anonymous page is the same page in the child.
+  a = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[0] = 'c';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || a[0] != 'c'){
+    printf("%s: child's write to shared page not seen\n", s);
+    exit(1);
+  }
+  munmap(a, PGSIZE);
+
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < MMAPPAGES; i++){
+    memset(buf, 'a' + i, sizeof(buf));
+    if(pwrite(fd, buf, sizeof(buf), i*PGSIZE) != sizeof(buf)){
+      printf("%s: pwrite failed\n", s);
+      exit(1);
+    }
+  }
+
+  a = mmap(0, MMAPPAGES*PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  b = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(a == (char*)-1 || b == (char*)-1){
+    printf("%s: file mmap failed\n", s);
+    exit(1);
+  }
+  // the kernel faults in an untouched page it copies to, even
+  // one of the file it is reading.
+  if(pread(fd, b + 8, 2, PGSIZE) != 2 || b[0] != 'a' || b[8] != 'b'){
+    printf("%s: read into untouched mapping failed\n", s);
+    exit(1);
+  }
+  // touching every page makes the pager evict file pages.
+  for(i = 0; i < MMAPPAGES; i++){
+    if(a[i*PGSIZE] != 'a' + i){
+      printf("%s: page %d of file mapping wrong\n", s, i);
+      exit(1);
+    }
+    a[i*PGSIZE] = 'A' + i;
+  }
+  for(i = 0; i < MMAPPAGES; i++)
+    if(a[i*PGSIZE] != 'A' + i){
+      printf("%s: page %d lost a write\n", s, i);
+      exit(1);
+    }
+  b[1] = 'x';
+  munmap(a, MMAPPAGES*PGSIZE);
+  munmap(b, PGSIZE);
+
+  for(i = 0; i < MMAPPAGES; i++){
+    if(pread(fd, buf, 2, i*PGSIZE) != 2 || buf[0] != 'A' + i || buf[1] != 'a' + i){
+      printf("%s: page %d not written back right\n", s, i);
+      exit(1);
+    }
+  }
+
+  // a read() into a mapping writes to it: it isn't allowed into
+  // a read-only one, and reaches the file from a shared one.
+  a = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  b = mmap(0, PGSIZE, PROT_READ, MAP_SHARED, fd, 0);
+  if(a == (char*)-1 || b == (char*)-1){
+    printf("%s: file mmap failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, b, 1, PGSIZE) != -1){
+    printf("%s: read into read-only mapping succeeded\n", s);
+    exit(1);
+  }
+  if(pread(fd, a + 2, 1, PGSIZE) != 1){
+    printf("%s: read into shared mapping failed\n", s);
+    exit(1);
+  }
+  munmap(a, PGSIZE);
+  munmap(b, PGSIZE);
+  if(pread(fd, buf, 3, 0) != 3 || buf[2] != 'B'){
+    printf("%s: read into shared mapping not written back\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+
+  // the region is gone after munmap.
+  pid = fork();
+  if(pid == 0){
+    a[0] = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: write to unmapped region did not fault\n", s);
+    exit(1);
+  }
+}
+
+// pagectl(): pinning takes effect at exec, a lower resident
+// limit swaps pages out, and the replacement policy, the
+// process's or the system's, can be changed with pages in
+// memory and in the swap file.
+void
+pagectltest(char *s)
+{
+  struct pagestat st;
+  int policies[] = { SCFIFO, NFUA, LAPA, FIFO, ARC };
+  int i, j, limit, old, pid, xstatus;
+  char *a;
+
+  if(pagestat(0, &st) < 0){
+    printf("%s: pagestat failed\n", s);
+    exit(1);
+  }
+  if(pagectl(PAGECTL_PIN, 1) != 0 || pagectl(PAGECTL_PIN, 0) != 1){
+    printf("%s: commands run by sh should not be pinned\n", s);
+    exit(1);
+  }
+  if(st.pinned)
+    return;
+  if(st.limit != MAX_PSYC_PAGES || pagectl(PAGECTL_LIMIT, 0) != -1 ||
+     pagectl(PAGECTL_POLICY, 99) != -1 || pagectl(PAGECTL_SYSPOLICY, NONE) != -1){
+    printf("%s: bad limit or policy accepted\n", s);
+    exit(1);
+  }
+
+  a = sbrk(4*PGSIZE);
+  for(i = 0; i < 4; i++)
+    a[i*PGSIZE] = i + 1;
+  // the smallest limit the process fits in, but no less than half.
+  limit = PGROUNDUP((uint64)sbrk(0)) / PGSIZE - MAX_PAGED_PAGES;
+  if(limit < MAX_PSYC_PAGES/2)
+    limit = MAX_PSYC_PAGES/2;
+  if(limit < MAX_PSYC_PAGES){
+    if(pagectl(PAGECTL_LIMIT, limit) != MAX_PSYC_PAGES){
+      printf("%s: pagectl limit failed\n", s);
+      exit(1);
+    }
+    pagestat(0, &st);
+    if(st.limit != limit || st.resident > limit){
+      printf("%s: %d pages resident, limit %d\n", s, st.resident, limit);
+      exit(1);
+    }
+  }
+
+  for(j = 0; j < sizeof(policies)/sizeof(policies[0]); j++){
+    if(pagectl(PAGECTL_POLICY, policies[j]) < 0){
+      printf("%s: pagectl policy %d failed\n", s, policies[j]);
+      exit(1);
+    }
+    for(i = 0; i < 4; i++){
+      if(a[i*PGSIZE] != i + j + 1){
+        printf("%s: page %d lost under policy %d\n", s, i, policies[j]);
+        exit(1);
+      }
+      a[i*PGSIZE]++;
+    }
+  }
+
+  // children inherit the attributes.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    pagestat(0, &st);
+    exit(st.limit != limit || st.policy != ARC || a[0] != 6);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit paging attributes\n", s);
+    exit(1);
+  }
+
+  // back to following the system-wide policy.
+  old = pagectl(PAGECTL_SYSPOLICY, NFUA);
+  if(old < 0 || pagectl(PAGECTL_POLICY, NONE) != ARC){
+    printf("%s: pagectl system policy failed\n", s);
+    exit(1);
+  }
+  pagestat(0, &st);
+  for(i = 0; i < 4; i++)
+    a[i*PGSIZE]++;
+  pagectl(PAGECTL_SYSPOLICY, old);
+  if(st.algo != NFUA || st.policy != NFUA || a[0] != 7){
+    printf("%s: not following the system-wide policy\n", s);
+    exit(1);
+  }
+  sbrk(-4*PGSIZE);
+}
+
+#define PGSTEP 64
+
+// How many pages a paging test may sbrk(): its resident limit
+// plus the swap file, less the program's own pages. Fills in
+// *st with the caller's paging statistics. Returns 0 if the
+// caller isn't paged.
+int
+pagingroom(char *s, struct pagestat *st)
+{
+  int n;
+
+  if(pagestat(0, st) < 0){
+    printf("%s: pagestat failed\n", s);
+    exit(1);
+  }
+  if(st->pinned)
+    return 0;
+  n = st->limit + MAX_PAGED_PAGES - 1 - PGROUNDUP((uint64)sbrk(0)) / PGSIZE;
+  return n > 0 ? n : 0;
+}
+
+// Write pattern k into the n pages at a: a byte every PGSTEP,
+// each different from the last, so that no page is all one
+// byte.
+void
+pgfill(char *a, int n, int k)
+{
+  int i;
+
+  for(i = 0; i < n*PGSIZE; i += PGSTEP)
+    a[i] = i/PGSIZE + (i%PGSIZE)/PGSTEP + k;
+}
+
+// Check that the n pages at a hold pattern k, and move them on
+// to pattern k+1. Returns the first page that didn't, or -1.
+int
+pgbump(char *a, int n, int k)
+{
+  int i;
+
+  for(i = 0; i < n*PGSIZE; i += PGSTEP){
+    if(a[i] != (char)(i/PGSIZE + (i%PGSIZE)/PGSTEP + k))
+      return i/PGSIZE;
+    a[i]++;
+  }
+  return -1;
+}
+
+// Pages the caller has brought back into memory, by any route.
+uint64
+pgins(struct pagestat *st)
+{
+  return st->swapins + st->zswapins + st->fillins + st->rescues;
+}
+
+// ARC keeps page contents as pages move between its clocks
+// and come back from the swap file as ghost hits, and a page
+// evicted from T1 and faulted in again while its ghost is in
+// b1 comes back on T2, and raises target.
+void
+arctest(char *s)
+{
+  struct pagestat st, before, after;
+  int i, j, n, lo, fd;
+  char *a;
+
+  if((n = pagingroom(s, &st)) == 0)
+    return;
+  if(pagectl(PAGECTL_POLICY, ARC) < 0){
+    printf("%s: no ARC policy\n", s);
+    exit(1);
+  }
+  // as many pages as fit in RAM, if there's room: with the
+  // program's own, more than do.
+  if(n > st.limit)
+    n = st.limit;
+  if(n < 2)
+    return;
+  a = sbrk(n*PGSIZE);
+  // page 0 is hot, while the rest are scanned.
+  for(j = 0; j < 4; j++){
+    if(a[0] != j*n){
+      printf("%s: hot page lost a write\n", s);
+      exit(1);
+    }
+    for(i = 0; i < n; i++){
+      if(a[i*PGSIZE + 1] != j){
+        printf("%s: page %d lost a write\n", s, i);
+        exit(1);
+      }
+      a[i*PGSIZE + 1]++;
+      a[0]++;
+    }
+  }
+  sbrk(-n*PGSIZE);
+
+  // fresh pages, that pwrite() reading from them brings into
+  // memory without marking them used. Starting ARC afresh puts
+  // every page in memory on T1, and a lower limit then evicts
+  // the unused ones first, into b1. Enough of them to fit back
+  // under the old limit, with room to lower it to lo.
+  lo = MAX_PSYC_PAGES / 2;
+  n = lo + MAX_PAGED_PAGES - 1 - PGROUNDUP((uint64)sbrk(0)) / PGSIZE;
+  if(n > st.limit - lo)
+    n = st.limit - lo;
+  if(n < 1)
+    return;
+  if((fd = open("arcprobe", O_CREATE|O_RDWR)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  a = sbrk(n*PGSIZE);
+  for(j = 0; j < 4; j++){
+    pagestat(0, &before);
+    for(i = 0; i < n; i++)
+      pwrite(fd, a + i*PGSIZE, 1, 0);
+    pagestat(0, &after);
+    if(pgins(&after) == pgins(&before))
+      break;
+  }
+  if(j == 4){
+    close(fd);
+    unlink("arcprobe");
+    sbrk(-n*PGSIZE);
+    return;
+  }
+  pagectl(PAGECTL_POLICY, LAPA);
+  pagectl(PAGECTL_POLICY, ARC);
+  if(pagectl(PAGECTL_LIMIT, lo) < 0 || pagectl(PAGECTL_LIMIT, st.limit) != lo){
+    printf("%s: pagectl limit failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    pagestat(0, &before);
+    if(pwrite(fd, a + i*PGSIZE, 1, 0) != 1){
+      printf("%s: pwrite failed\n", s);
+      exit(1);
+    }
+    pagestat(0, &after);
+    if(pgins(&after) == pgins(&before))
+      continue;
+    if(after.ghosthits != before.ghosthits + 1){
+      printf("%s: page %d came back without a ghost hit\n", s, i);
+      exit(1);
+    }
+    if(after.evictions == before.evictions &&
+       (after.arct2 != before.arct2 + 1 ||
+        (after.arctarget <= before.arctarget && after.arctarget != after.limit))){
+      printf("%s: page %d came back from b1, but not on T2\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("arcprobe");
+  sbrk(-n*PGSIZE);
+}
+
+// pages swapped out to the compressed pool, and with the
+// pool turned off, to disk, come back the same.
+void
+zswaptest(char *s)
+{
+  struct pagestat st, before, after;
+  int i, j, n, on;
+  char *a;
+
+  if((n = pagingroom(s, &st)) > st.limit)
+    n = st.limit;
+  if(n < 1)
+    return;
+  a = sbrk(n*PGSIZE);
+  pgfill(a, n, 0);
+
+  on = pagectl(PAGECTL_ZSWAP, 1);
+  for(j = 0; j < 2; j++){
+    pagestat(0, &before);
+    if((i = pgbump(a, n, j)) >= 0){
+      pagectl(PAGECTL_ZSWAP, on);
+      printf("%s: page %d lost a write\n", s, i);
+      exit(1);
+    }
+    pagestat(0, &after);
+    // the second time around, with the pool off.
+    if(j == 0 && after.swapouts + after.zswapouts > before.swapouts + before.zswapouts &&
+       after.zswapouts == before.zswapouts){
+      pagectl(PAGECTL_ZSWAP, on);
+      printf("%s: no page went to the pool\n", s);
+      exit(1);
+    }
+    if(j == 1 && after.zswapouts != before.zswapouts){
+      pagectl(PAGECTL_ZSWAP, on);
+      printf("%s: page went to the pool with it off\n", s);
+      exit(1);
+    }
+    pagectl(PAGECTL_ZSWAP, 0);
+  }
+  pagectl(PAGECTL_ZSWAP, on);
+  sbrk(-n*PGSIZE);
+}
+
+// pages all of one byte are swapped out into their PTEs,
+// and come back filled in, in the process and in a child.
+void
+filltest(char *s)
+{
+  struct pagestat st, before, after;
+  int i, j, n, pid, xstatus;
+  char *a;
+
+  if((n = pagingroom(s, &st)) > st.limit)
+    n = st.limit;
+  if(n < 1)
+    return;
+  a = sbrk(n*PGSIZE);
+  pagestat(0, &before);
+  for(j = 0; j < 2; j++){
+    for(i = 0; i < n; i++){
+      if(a[i*PGSIZE] != (j ? 'a' + i : 0) || a[i*PGSIZE + PGSIZE-1] != a[i*PGSIZE]){
+        printf("%s: page %d has the wrong fill\n", s, i);
+        exit(1);
+      }
+      memset(a + i*PGSIZE, 'a' + i, PGSIZE);
+    }
+  }
+  pagestat(0, &after);
+  if(after.swapouts + after.zswapouts + after.fillouts > before.swapouts + before.zswapouts + before.fillouts &&
+     after.fillouts == before.fillouts){
+    printf("%s: no page was swapped out as a fill\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < n; i++)
+      for(j = 0; j < PGSIZE; j += 512)
+        if(a[i*PGSIZE + j] != 'a' + i)
+          exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child has the wrong fill\n", s);
+    exit(1);
+  }
+  sbrk(-n*PGSIZE);
+}
+
+// pagestat() of the caller, by pid, and of the system agree,
+// and eviction and fault service counts add up.
+void
+pgcounttest(char *s)
+{
+  struct pagestat st, before, after, sys;
+  uint64 lat;
+  int i, j, k, n;
+  char *a;
+
+  if(pagestat(0, &st) < 0 || pagestat(getpid(), &before) < 0 ||
+     pagestat(-1, &sys) < 0){
+    printf("%s: pagestat failed\n", s);
+    exit(1);
+  }
+  if(pagestat(1000000, &st) >= 0){
+    printf("%s: pagestat of no process succeeded\n", s);
+    exit(1);
+  }
+  if(before.faults < st.faults || sys.faults < before.faults){
+    printf("%s: system has fewer faults than the process\n", s);
+    exit(1);
+  }
+  if((n = pagingroom(s, &before)) <= before.limit)
+    return;
+  a = sbrk(n*PGSIZE);
+  for(j = 0; j < 2; j++)
+    for(i = 0; i < n; i++)
+      a[i*PGSIZE] = i + j;
+  pagestat(0, &after);
+  pagestat(-1, &sys);
+  if(after.evictions == before.evictions){
+    printf("%s: nothing was evicted\n", s);
+    exit(1);
+  }
+  if(after.scans - before.scans < after.evictions - before.evictions){
+    printf("%s: fewer scans than evictions\n", s);
+    exit(1);
+  }
+  lat = 0;
+  for(k = 0; k < NFAULTLAT; k++)
+    lat += (after.faultlat[k] - before.faultlat[k]);
+  if(lat != after.faults - before.faults){
+    printf("%s: %l faults but %l in the histogram\n", s,
+           after.faults - before.faults, lat);
+    exit(1);
+  }
+  if(sys.evictions < after.evictions){
+    printf("%s: system has fewer evictions than the process\n", s);
+    exit(1);
+  }
+  sbrk(-n*PGSIZE);
+}
+
+// with tracing on, a system call leaves a call and a return
+// event, in order, and with tracing off it leaves none. It has
+// to be one that traps: getpid() reads the USYSCALL page.
+void
+tracetest(char *s)
+{
+  struct tracerec rec[16];
+  int i, n, on, pid, call, ret;
+  char *brk;
+
+  on = tracectl(0);
+  while((n = traceread(rec, sizeof(rec)/sizeof(rec[0]))) > 0)
+    ;
+  if(n < 0){
+    printf("%s: traceread failed\n", s);
+    exit(1);
+  }
+  pid = getpid();
+  tracectl(1);
+  brk = sbrk(0);
+  tracectl(0);
+  sbrk(0);
+  call = ret = 0;
+  while((n = traceread(rec, sizeof(rec)/sizeof(rec[0]))) > 0){
+    for(i = 0; i < n; i++){
+      if(rec[i].pid != pid || rec[i].a0 != SYS_sbrk)
+        continue;
+      if(rec[i].type == TR_SYSCALL)
+        call++;
+      if(rec[i].type == TR_SYSRET && call > ret && rec[i].a1 == (uint64)brk)
+        ret++;
+    }
+  }
+  tracectl(on);
+  if(call != 1 || ret != 1){
+    printf("%s: %d sbrk calls and %d returns traced\n", s, call, ret);
+    exit(1);
+  }
+}
+
+// the profiler catches a process spinning in user code,
+// and profread() ends once profiling is off.
+void
+proftest(char *s)
+{
+  struct profsample rec[16];
+  uint64 start, lost;
+  int i, n, on, pid, mine;
+  volatile int x;
+
+  pid = getpid();
+  on = profctl(1);
+  x = 0;
+  start = uptimens();
+  while(uptimens() - start < 50*1000*1000)
+    x++;
+  profctl(0);
+  mine = 0;
+  while((n = profread(rec, sizeof(rec)/sizeof(rec[0]), &lost)) > 0){
+    for(i = 0; i < n; i++)
+      if(rec[i].pid == pid && rec[i].user && strcmp(rec[i].name, "usertests") == 0)
+        mine++;
+  }
+  profctl(on);
+  if(n < 0){
+    printf("%s: profread failed\n", s);
+    exit(1);
+  }
+  if(mine == 0){
+    printf("%s: no samples of a spinning process\n", s);
+    exit(1);
+  }
+}
+
+// pages swapped out to disk go through the laundry queue:
+// whether they are rescued from it or written out and read
+// back, they keep their data, in the process and in a child
+// forked while some are still queued.
+void
+laundrytest(char *s)
+{
+  struct pagestat st, before, after;
+  int i, j, n, on, pid, xstatus;
+  char *a;
+
+  if((n = pagingroom(s, &st)) <= st.limit)
+    return;
+  on = pagectl(PAGECTL_ZSWAP, 0);
+  a = sbrk(n*PGSIZE);
+  pgfill(a, n, 0);
+  pagestat(0, &before);
+  for(j = 0; j < 3; j++){
+    if((i = pgbump(a, n, j)) >= 0){
+      pagectl(PAGECTL_ZSWAP, on);
+      printf("%s: page %d lost a write\n", s, i);
+      exit(1);
+    }
+  }
+  pagestat(0, &after);
+  if(after.swapouts == before.swapouts){
+    pagectl(PAGECTL_ZSWAP, on);
+    printf("%s: nothing was swapped out\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    pagectl(PAGECTL_ZSWAP, on);
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if((i = pgbump(a, n, 3)) >= 0){
+    printf("%s: %s lost page %d\n", s, pid == 0 ? "child" : "parent", i);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(&xstatus);
+  pagectl(PAGECTL_ZSWAP, on);
+  if(xstatus != 0)
+    exit(xstatus);
+  // with pages still queued, if any.
+  sbrk(-n*PGSIZE);
+}
+
+// write() from and read() into a buffer that is mostly swapped
+// out. The kernel doesn't fault pages in under the file's
+// locks, so it has to copy them through a page of its own.
+void
+swapiotest(char *s)
+{
+  struct pagestat st;
+  int fd, i, n;
+  char *a;
+
+  if((n = pagingroom(s, &st)) <= st.limit)
+    return;
+  a = sbrk(n*PGSIZE);
+  pgfill(a, n, 0);
+  fd = open("swapio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if(write(fd, a, n*PGSIZE) != n*PGSIZE){
+    printf("%s: write from swapped-out pages failed\n", s);
+    exit(1);
+  }
+  pgfill(a, n, 1);
+  if(pread(fd, a, n*PGSIZE, 0) != n*PGSIZE){
+    printf("%s: read into swapped-out pages failed\n", s);
+    exit(1);
+  }
+  if((i = pgbump(a, n, 0)) >= 0){
+    printf("%s: page %d read back wrong\n", s, i);
+    exit(1);
+  }
+  close(fd);
+  unlink("swapio");
+  sbrk(-n*PGSIZE);
+}
+
+// processes paging at once, on all CPUs, while the scheduler
+// ages their pages, each keep their own data.
+void
+pglocktest(char *s)
+{
+  enum { NCHILD=4 };
+  struct pagestat st;
+  int i, j, k, n, pid, xstatus;
+  char *a;
+
+  if((n = pagingroom(s, &st)) <= st.limit)
+    return;
+  for(k = 0; k < NCHILD; k++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      a = sbrk(n*PGSIZE);
+      pgfill(a, n, k);
+      for(j = 0; j < 4; j++){
+        if((i = pgbump(a, n, k + j)) >= 0){
+          printf("%s: child %d lost page %d\n", s, k, i);
+          exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+  for(k = 0; k < NCHILD; k++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+}
+
+// a failed exec leaves the caller as it was: its mmap()
+// regions, its paging attributes and its swapped-out pages.
+void
+execfailtest(char *s)
+{
+  static char *args[MAXARG], big[256];
+  struct pagestat before, after;
+  int i, n, old;
+  char *a, *m;
+
+  memset(big, 'x', sizeof(big) - 1);
+  for(i = 0; i < MAXARG-1; i++)
+    args[i] = big;
+  args[MAXARG-1] = 0;
+  n = pagingroom(s, &before);
+  m = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(m == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  m[0] = 'm';
+  a = sbrk(n*PGSIZE);
+  pgfill(a, n, 0);
+  old = pagectl(PAGECTL_PIN, !before.pinned);
+
+  // more arguments than fit on the stack: exec fails once
+  // it has loaded echo.
+  if(exec("echo", args) != -1){
+    printf("%s: exec with too big arguments succeeded\n", s);
+    exit(1);
+  }
+  pagectl(PAGECTL_PIN, old);
+  pagestat(0, &after);
+  if(after.pinned != before.pinned){
+    printf("%s: failed exec changed pinning\n", s);
+    exit(1);
+  }
+  if(m[0] != 'm'){
+    printf("%s: failed exec lost an mmap() region\n", s);
+    exit(1);
+  }
+  if((i = pgbump(a, n, 0)) >= 0){
+    printf("%s: failed exec lost page %d\n", s, i);
+    exit(1);
+  }
+  munmap(m, PGSIZE);
+  sbrk(-n*PGSIZE);
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2634,6 +3674,23 @@ struct test {
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
   {badarg, "badarg" },
+  {sleepnstest, "sleepns" },
+  {usyscall, "usyscall" },
+  {ioring, "ioring" },
+  {vectorio, "vectorio" },
+  {mmaptest, "mmaptest" },
+  {arenatest, "arenatest" },
+  {pagectltest, "pagectltest" },
+  {execfailtest, "execfailtest" },
+  {arctest, "arctest" },
+  {zswaptest, "zswaptest" },
+  {filltest, "filltest" },
+  {pgcounttest, "pgcounttest" },
+  {tracetest, "tracetest" },
+  {proftest, "proftest" },
+  {laundrytest, "laundrytest" },
+  {swapiotest, "swapiotest" },
+  {pglocktest, "pglocktest" },
 
   { 0, 0},
 };
@@ -4,70 +4,214 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-struct buffer {
-    struct buffer *prevb;
-    int size;
+// Arenas: region allocators for short-lived memory.
+//
+// An arena hands out memory by bumping a pointer through
+// chunks of whole pages taken from sbrk(). Nothing is freed
+// on its own: arena_release() drops everything allocated since
+// a mark, and arena_reset() drops everything. Whatever that
+// leaves unused at the top of the heap goes back to the kernel
+// in a single sbrk(). Chunks buried under later sbrk()s (by
+// malloc(), say) stay with the arena and are reused.
+//
+// ustack_malloc() and ustack_free() are a LIFO stack of
+// buffers on the "ustack" arena.
+
+#define NARENA 8
+#define ALIGN(p, a) ((char*)(((uint64)(p) + (a) - 1) & ~(uint64)((a) - 1)))
+
+struct chunk {
+    struct chunk *prev;     // older chunk of the same arena
+    struct chunk *next;     // newer chunk of the same arena
+    char *end;              // end of the chunk's pages
+};
+
+struct arena {
+    char name[16];
+    struct chunk *first;    // chunks, oldest first
+    struct chunk *last;
+    struct chunk *cur;      // chunk being allocated from, or 0
+    char *top;              // next free byte in cur
 };
 
-typedef struct buffer Buffer;
+static struct arena arenas[NARENA];
+
+static char* chunkdata(struct chunk *c) {
+    return (char*)(c + 1);
+}
+
+// Return the arena called name, creating it if need be.
+// Returns 0 if there are already NARENA arenas.
+struct arena* arena_get(char *name) {
+    struct arena *a;
+
+    for (a = arenas; a < &arenas[NARENA]; a++) {
+        if (a->name[0] && strcmp(a->name, name) == 0)
+            return a;
+    }
+    for (a = arenas; a < &arenas[NARENA]; a++) {
+        if (a->name[0] == 0) {
+            memmove(a->name, name, sizeof(a->name) - 1);
+            a->name[sizeof(a->name) - 1] = 0;
+            return a;
+        }
+    }
+    return 0;
+}
+
+// Append a new chunk of at least len bytes to a.
+static struct chunk* newchunk(struct arena *a, uint64 len) {
+    struct chunk *c;
+    char *brk;
+    uint64 pad, n;
 
-static Buffer base;
-static Buffer *lastb;
+    brk = sbrk(0);
+    pad = (PGSIZE - (uint64)brk % PGSIZE) % PGSIZE;
+    n = PGROUNDUP(sizeof(struct chunk) + len);
+    if (pad + n > 0x7fffffff || sbrk(pad + n) == (char*)-1)
+        return 0;
+    c = (struct chunk*)(brk + pad);
+    c->end = (char*)c + n;
+    c->next = 0;
+    c->prev = a->last;
+    if (a->last)
+        a->last->next = c;
+    else
+        a->first = c;
+    a->last = c;
+    return c;
+}
 
-static uint64 newpage(void) {
+// Allocate len bytes from a, aligned to align bytes, which
+// must be a power of two, or 0 for ARENA_ALIGN.
+// Returns 0 if out of memory.
+void* arena_alloc(struct arena *a, uint len, uint align) {
+    struct chunk *c;
     char *p;
-    if ((p = sbrk(PGSIZE)) == (char*)-1)
+    uint64 n;
+
+    if (align == 0)
+        align = ARENA_ALIGN;
+    if (align & (align - 1))
         return 0;
-    base.size += PGSIZE;
-    return (uint64)p;
+    for (;;) {
+        if ((c = a->cur) == 0) {
+            if ((c = a->first) == 0 && (c = newchunk(a, (uint64)len + align)) == 0)
+                return 0;
+            a->cur = c;
+            a->top = chunkdata(c);
+        }
+        p = ALIGN(a->top, align);
+        if (p + len <= c->end) {
+            a->top = p + len;
+            return p;
+        }
+        if (c->next) {
+            // an emptied chunk, left over from a release.
+            a->cur = c->next;
+            a->top = chunkdata(a->cur);
+        } else if (c->end == sbrk(0)) {
+            // the last chunk is at the top of the heap: grow it.
+            n = PGROUNDUP((uint64)(p + len - c->end));
+            if (n > 0x7fffffff || sbrk(n) == (char*)-1)
+                return 0;
+            c->end += n;
+        } else {
+            if ((c = newchunk(a, (uint64)len + align)) == 0)
+                return 0;
+            a->cur = c;
+            a->top = chunkdata(c);
+        }
+    }
 }
 
-static Buffer* newbuffer(uint len) {
-    Buffer *b;
-    char *pos;
-    pos = (char*)lastb + lastb->size + sizeof(Buffer);
-    b = (Buffer*)(pos);
-    b->size = len;
-    base.size -= (len + sizeof(Buffer));
-    b->prevb = lastb;
-    lastb = b;
-    return b + 1;
+// Give the kernel back a's unused pages at the top of the
+// heap, in one sbrk(): the chunks after a->cur, and the
+// unused end of a->cur.
+static void trim(struct arena *a) {
+    struct chunk *c;
+    char *brk, *lo;
+
+    // release [lo, brk); c ends up as the newest chunk to keep.
+    brk = sbrk(0);
+    lo = brk;
+    for (c = a->last; c != 0 && c != a->cur && c->end == lo; c = c->prev)
+        lo = (char*)c;
+    if (c != 0 && c == a->cur && c->end == lo)
+        lo = (char*)PGROUNDUP((uint64)a->top);
+    if (lo == brk || sbrk(-(int)(brk - lo)) == (char*)-1)
+        return;
+    if (c != 0 && c->end > lo)
+        c->end = lo;
+    a->last = c;
+    if (c)
+        c->next = 0;
+    else
+        a->first = 0;
 }
 
-void* ustack_malloc(uint len) {
-    if (len > MAXSIZE) {
-        return (void*)-1;
-    }
+// Where a would allocate next, for arena_release().
+void* arena_mark(struct arena *a) {
+    return a->top;
+}
+
+// Free everything allocated from a since arena_mark()
+// returned mark.
+void arena_release(struct arena *a, void *mark) {
+    struct chunk *c;
 
-    Buffer *b;
-    if ((b = lastb) == 0) {
-        base.prevb = lastb = b = &base;
-        base.size = 0;  
+    if (mark == 0) {
+        arena_reset(a);
+        return;
     }
-    int newsz = base.size - sizeof(Buffer) - len;
-    if (newsz < 0) {
-        if ((b = (Buffer*)newpage()) == 0)
-            return (void*)-1;
-        if (lastb == &base) {
-            b->prevb = lastb;
-            b->size = len;
-            lastb = b;
-            base.size -= sizeof(Buffer) + len;
-            return (void *) (b + 1);
-        }
+    for (c = a->cur; c != 0; c = c->prev) {
+        if ((char*)mark >= chunkdata(c) && (char*)mark <= c->end)
+            break;
     }
-    return (void *)newbuffer(len);
+    if (c == 0)
+        return;
+    a->cur = c;
+    a->top = mark;
+    trim(a);
+}
+
+// Free everything allocated from a.
+void arena_reset(struct arena *a) {
+    a->cur = 0;
+    a->top = 0;
+    trim(a);
+}
+
+// The buffers of the ustack each start with a frame.
+struct frame {
+    struct frame *prevf;    // the buffer below this one
+    void *mark;             // arena mark from before this buffer
+};
+
+static struct arena *ustack;
+static struct frame *lastf;
+
+void* ustack_malloc(uint len) {
+    struct frame *f;
+    void *mark;
+
+    if (ustack == 0 && (ustack = arena_get("ustack")) == 0)
+        return (void*)-1;
+    mark = arena_mark(ustack);
+    if ((f = arena_alloc(ustack, sizeof(*f) + len, 0)) == 0)
+        return (void*)-1;
+    f->prevf = lastf;
+    f->mark = mark;
+    lastf = f;
+    return f + 1;
 }
 
 int ustack_free(void) {
-    if (lastb == &base) {
+    struct frame *f;
+
+    if ((f = lastf) == 0)
         return -1;
-    }
-    base.size += lastb->size + sizeof(Buffer);
-    lastb = lastb->prevb;
-    if (base.size >= PGSIZE) {
-        base.size -= PGSIZE;
-        sbrk(-PGSIZE);
-    }
+    lastf = f->prevf;
+    arena_release(ustack, f->mark);
     return 0;
-}
\ No newline at end of file
+}
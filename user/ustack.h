@@ -1,5 +1,12 @@
 #include "kernel/types.h"
 #include "kernel/riscv.h"
 
+#define ARENA_ALIGN 16  // default alignment of arena_alloc()
+
+struct arena* arena_get(char *name);
+void* arena_alloc(struct arena *a, uint len, uint align);
+void* arena_mark(struct arena *a);
+void arena_release(struct arena *a, void *mark);
+void arena_reset(struct arena *a);
 void* ustack_malloc(uint len);
 int ustack_free(void);
\ No newline at end of file